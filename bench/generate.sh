@@ -0,0 +1,24 @@
+#!/bin/sh
+# Writes a large bass program to stdout for benchmarking the parser, with a
+# mix of labels, comments, arithmetic, memory accesses, jumps and prints that
+# roughly follows the examples. The program jumps straight to its end so that
+# running it only measures parsing.
+#
+# usage: bench/generate.sh [BLOCKS] > large.bass   (about 160 bytes per block)
+
+blocks=${1:-100000}
+awk -v blocks="$blocks" 'BEGIN {
+    print "; generated by bench/generate.sh"
+    print "jump end"
+    for (i = 0; i < blocks; i++) {
+        r = i % 8
+        printf "block_%d:\n", i
+        printf "    move r%d #%d\n", r, i
+        printf "    add r%d r%d @%d    ; %d\n", r, (r + 1) % 8, (i * 4) % 4096, i
+        printf "    store r%d #0x%x\n", r, i
+        printf "    cmp r%d #%d\n", r, -i
+        printf "    jumpl block_%d\n", i
+        printf "    println \"block %d\"\n", i
+    }
+    print "end:"
+}'
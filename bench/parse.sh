@@ -0,0 +1,34 @@
+#!/bin/sh
+# Measures parse throughput on a file written by bench/generate.sh, using the
+# wall time that `--stats` reports for parsing (which includes reading the
+# file and linking). Reports the best of RUNS runs with a single thread and
+# with every cpu.
+#
+# On a single core `parse` alone runs at 150-200 MB/s and the whole phase at
+# about 100 MB/s. Every line of about 20 bytes turns into a 112 byte OpCode,
+# so most of the time goes into faulting in and writing the output rather
+# than into reading the source. More threads scale that up on more cores.
+#
+# usage: bench/parse.sh [BASS] [BLOCKS] [RUNS]
+
+bass=${1:-./bass}
+blocks=${2:-100000}
+runs=${3:-5}
+file=$(mktemp "${TMPDIR:-/tmp}/bass-bench.XXXXXX")
+trap 'rm -f "$file"' EXIT
+"$(dirname "$0")/generate.sh" "$blocks" > "$file"
+size=$(wc -c < "$file")
+
+for jobs in $(printf '%s\n' 1 "$(nproc)" | sort -un); do
+    i=0
+    while [ "$i" -lt "$runs" ]; do
+        "$bass" --jobs "$jobs" --stats "$file" 2>&1 >/dev/null |
+            awk '/stats for parsing/ { found = 1 }
+                 found && /wall time/ { sub("s$", "", $3); print $3; exit }'
+        i=$((i + 1))
+    done | sort -g | head -n 1 |
+        awk -v size="$size" -v jobs="$jobs" '{
+            printf "%.1f MB with %d jobs: %.3fs (%.0f MB/s)\n",
+                   size / 1e6, jobs, $1, size / 1e6 / $1
+        }'
+done
@@ -1,43 +1,274 @@
 #include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "interpreter.h"
 #include "constants.h"
 #include "parser.h"
 #include "utils.h"
 
+// memory is mapped anonymously (zero filled) so that host files can later be
+// mapped over parts of it with MAP_FIXED
+bool state_init(State *state) {
+    memset(state, 0, sizeof(*state));
+    void *memory = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    state->memory = memory;
+    return true;
+}
+
+void state_free(State *state) {
+    // unmapping the whole region also flushes back any `rw` file mappings
+    if (state->memory) {
+        munmap(state->memory, MEMORY_SIZE);
+    }
+    free(state->mappings.data);
+    memset(state, 0, sizeof(*state));
+}
+
+static inline size_t page_align(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+// Resets a state so that it can run another program. The memory pages are
+// dropped instead of cleared so that resetting is cheap when a program only
+// touched a small part of the memory. File mappings are replaced with zeroed
+// memory as well, they have to be mapped again after the next image is loaded
+// so that files take precedence over data the same way as on a fresh state.
+void state_reset(State *state) {
+    for (size_t i = 0; i < state->mappings.size; i++) {
+        Mapping m = state->mappings.data[i];
+        void *addr = mmap(&state->memory[m.addr], page_align(m.length),
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        assert(addr != MAP_FAILED &&
+               "Catastrophic Failure: Couldnt unmap a file!");
+    }
+    state->mappings.size = 0;
+    madvise(state->memory, MEMORY_SIZE, MADV_DONTNEED);
+    memset(state->registers, 0, sizeof(state->registers));
+    memset(state->stack, 0, sizeof(state->stack));
+    state->reg_sp = 0;
+    state->reg_pc = 0;
+    state->flag_cmp = 0;
+    state->retired = 0;
+}
+
+// Copies the data segments declared with directives into memory. This
+// happens before any file is mapped, files take the place of the data below.
+void state_load_image(State *state, DataSegments data) {
+    for (size_t i = 0; i < data.size; i++) {
+        DataSegment segment = data.data[i];
+        memcpy(&state->memory[segment.address], segment.bytes, segment.size);
+    }
+}
+
+bool state_map_file(State *state, Mapping mapping) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (mapping.addr % page != 0) {
+        fprintf(stderr,
+                "bass: mapping address `%zu` for `%s` is not page aligned\n"
+                "help: use a multiple of %zu\n",
+                mapping.addr, mapping.path, page);
+        return false;
+    }
+
+    int fd = open(mapping.path, mapping.writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "bass: failed to open mapped file `%s`: %s\n",
+                mapping.path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "bass: couldnt stat mapped file `%s`: %s\n",
+                mapping.path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "bass: cannot map empty file `%s`\n", mapping.path);
+        close(fd);
+        return false;
+    }
+    mapping.length = st.st_size;
+
+    if (mapping.addr >= MEMORY_SIZE ||
+        page_align(mapping.length) > MEMORY_SIZE - mapping.addr) {
+        fprintf(stderr,
+                "bass: mapping of `%s` (%zu bytes at @%zu) does not fit into "
+                "memory of %d bytes\n",
+                mapping.path, mapping.length, mapping.addr, MEMORY_SIZE);
+        close(fd);
+        return false;
+    }
+    size_t end = mapping.addr + page_align(mapping.length);
+    for (size_t i = 0; i < state->mappings.size; i++) {
+        Mapping other = state->mappings.data[i];
+        size_t other_end = other.addr + page_align(other.length);
+        if (mapping.addr < other_end && other.addr < end) {
+            fprintf(stderr,
+                    "bass: mapping of `%s` at @%zu overlaps mapping of `%s` "
+                    "at @%zu\n",
+                    mapping.path, mapping.addr, other.path, other.addr);
+            close(fd);
+            return false;
+        }
+    }
+
+    int prot = mapping.writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = (mapping.writable ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+    void *addr = mmap(&state->memory[mapping.addr], mapping.length, prot,
+                      flags, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "bass: failed to map `%s`: %s\n", mapping.path,
+                strerror(errno));
+        return false;
+    }
+    dyn_append(&state->mappings, mapping);
+    return true;
+}
+
+// finds a read-only mapping overlapping `size` bytes at `index`
+static Mapping *find_read_only(State *state, size_t index, size_t size) {
+    for (size_t i = 0; i < state->mappings.size; i++) {
+        Mapping *m = &state->mappings.data[i];
+        if (!m->writable && index < m->addr + page_align(m->length) &&
+            m->addr < index + size) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+// checks that a write of `width` bytes at `index` doesnt touch a read-only
+// mapping
+static bool check_writable(State *state, OpCode *op, size_t index,
+                           int width) {
+    Mapping *m = find_read_only(state, index, width);
+    if (m) {
+        fprintf(stderr,
+                "bass: write to read-only mapping of `%s` at address "
+                "`%zu` in opcode `%s` at: %d:%zu\n",
+                m->path, index, OPCODES[op->op].name, op->line, op->col);
+        return false;
+    }
+    return true;
+}
+
+#define CHECK_WRITABLE(state, op, index, width)                                \
+    ((state)->mappings.size == 0 ||                                            \
+     check_writable((state), (op), (index), (width)))
+
+// `@N` and `@rN` operands always access a 32-bit word
+#define WORD_WIDTH 4
+
+// Memory is accessed through memcpy so that unaligned addresses are well
+// defined. Bytes and halfwords are zero extended, words are sign extended.
+static inline int64_t mem_read(State *state, size_t index, int width) {
+    if (state->trace) {
+        memtrace_record(state->trace, state->reg_pc - 1, index, width, false);
+    }
+    unsigned char *ptr = &state->memory[index];
+    switch (width) {
+    case 1:
+        return *ptr;
+    case 2: {
+        uint16_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    case 4: {
+        int32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    case 8: {
+        int64_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    default:
+        assert(false && "Invalid memory access width");
+    }
+}
+
+// stores the lowest `width` bytes of `value`
+static inline void mem_write(State *state, size_t index, int width,
+                             int64_t value) {
+    if (state->trace) {
+        memtrace_record(state->trace, state->reg_pc - 1, index, width, true);
+    }
+    unsigned char *ptr = &state->memory[index];
+    switch (width) {
+    case 1:
+        *ptr = (uint8_t)value;
+        break;
+    case 2: {
+        uint16_t v = value;
+        memcpy(ptr, &v, sizeof(v));
+    } break;
+    case 4: {
+        uint32_t v = value;
+        memcpy(ptr, &v, sizeof(v));
+    } break;
+    case 8:
+        memcpy(ptr, &value, sizeof(value));
+        break;
+    default:
+        assert(false && "Invalid memory access width");
+    }
+}
+
 // evaluates values that are treated as integers
-static inline int eval_int(State *state, Operand operand) {
+static inline int64_t eval_int(State *state, Operand operand) {
     switch (operand.type) {
     case TOK_LITERAL_NUM:
-        return operand.value;
+        return wrap(state, operand.value);
     case TOK_REGISTER:
         return state->registers[operand.value];
     case TOK_ADDRESS:
-        return *(int *)(&state->memory[operand.value]);
+        return mem_read(state, operand.value, WORD_WIDTH);
     case TOK_ADDRESS_REG:
-        return *(int *)(&state->memory[state->registers[operand.value]]);
+        return mem_read(state, state->registers[operand.value], WORD_WIDTH);
     default:
         assert(false && "Passed in value was not an integer!");
     }
 }
 
-static inline bool set_lval(State *state, OpCode *op, int rval) {
+static inline bool set_lval(State *state, OpCode *op, int64_t rval) {
     // first operand is always the lvalue to be set
     Operand lval = op->operands[0];
 
     switch (lval.type) {
     case TOK_REGISTER:
-        state->registers[lval.value] = rval;
+        state->registers[lval.value] = wrap(state, rval);
         return true;
     case TOK_ADDRESS:
-        *(int *)(&state->memory[lval.value]) = rval;
+        if (!CHECK_WRITABLE(state, op, lval.value, WORD_WIDTH)) {
+            return false;
+        }
+        mem_write(state, lval.value, WORD_WIDTH, rval);
         return true;
-    case TOK_ADDRESS_REG:
-        *(int *)(&state->memory[state->registers[lval.value]]) = rval;
+    case TOK_ADDRESS_REG: {
+        int64_t index = state->registers[lval.value];
+        if (!CHECK_WRITABLE(state, op, index, WORD_WIDTH)) {
+            return false;
+        }
+        mem_write(state, index, WORD_WIDTH, rval);
         return true;
+    }
     default: {
         fprintf(
             stderr,
@@ -59,17 +290,20 @@ static inline int unreachable() {
     return 0;
 }
 
+// add, sub and mul are done on unsigned values so that overflow wraps around,
+// dividing by -1 is a negation so that INT64_MIN / -1 wraps as well instead
+// of trapping
 #define CALCULATE(op, a, b)                                                    \
-    ((op) == OP_ADD)   ? a + b                                                 \
-    : ((op) == OP_SUB) ? a - b                                                 \
-    : ((op) == OP_MUL) ? a *b                                                  \
-    : ((op) == OP_DIV) ? a / b                                                 \
-    : ((op) == OP_MUL) ? a % b                                                 \
+    ((op) == OP_ADD)   ? (int64_t)((uint64_t)a + (uint64_t)b)                  \
+    : ((op) == OP_SUB) ? (int64_t)((uint64_t)a - (uint64_t)b)                  \
+    : ((op) == OP_MUL) ? (int64_t)((uint64_t)a * (uint64_t)b)                  \
+    : ((op) == OP_DIV) ? ((b) == -1 ? (int64_t)(0 - (uint64_t)a) : a / b)      \
+    : ((op) == OP_MOD) ? ((b) == -1 ? 0 : a % b)                               \
                        : unreachable()
 
 bool calculate_and_set(State *state, OpCode *opcode) {
-    int first = eval_int(state, opcode->operands[1]);
-    int second = eval_int(state, opcode->operands[2]);
+    int64_t first = eval_int(state, opcode->operands[1]);
+    int64_t second = eval_int(state, opcode->operands[2]);
     OpType op = opcode->op;
 
     if ((op == OP_DIV || op == OP_MOD) && second == 0) {
@@ -83,16 +317,189 @@ bool calculate_and_set(State *state, OpCode *opcode) {
     return true;
 }
 
+// `interpret_slice` makes sure that there is enough room for every print
+static inline void output_write(Output *output, const char *data, size_t size) {
+    memcpy(&output->data[output->size], data, size);
+    output->size += size;
+}
+
 static inline void execute_print(State *state, Operand operand) {
+    if (state->output) {
+        char number[24];
+        switch (operand.type) {
+        case TOK_LITERAL_CHAR:
+            number[0] = operand.value;
+            output_write(state->output, number, 1);
+            break;
+        case TOK_LITERAL_STR:
+            output_write(state->output, operand.string.data,
+                         operand.string.length);
+            break;
+        default:
+            output_write(state->output, number,
+                         sprintf(number, "%" PRId64,
+                                 eval_int(state, operand)));
+        }
+        return;
+    }
     switch (operand.type) {
     case TOK_LITERAL_CHAR:
-        printf("%c", operand.value);
+        printf("%c", (char)operand.value);
         break;
     case TOK_LITERAL_STR:
         printf("%.*s", SV_FORMAT(operand.string));
         break;
     default:
-        printf("%d", eval_int(state, operand));
+        printf("%" PRId64, eval_int(state, operand));
+    }
+}
+
+// address of the first word accessed through an induction by a loop that is
+// about to start another iteration
+static inline int64_t loop_address(State *state, Induction induction) {
+    return state->registers[induction.reg] +
+           (induction.before_access ? induction.step : 0);
+}
+
+// checks that `count` words from `address` are inside of the memory
+static inline bool in_memory(int64_t address, size_t count) {
+    return address >= 0 && (size_t)address <= MEMORY_SIZE - count * WORD_WIDTH;
+}
+
+// Runs the remaining iterations of a loop found by `find_loops` natively,
+// with `reg_pc` at the start of its body. Leaves the state untouched and
+// returns false when that isnt safe, the loop is then simply interpreted.
+// Only the iterations up to the deadline of the slice are run, after which
+// `reg_pc` is left at the start of the body for the next slice.
+static bool run_loop(State *state, const Loop *loop) {
+    // memory accesses have to be recorded one by one
+    if (state->trace) {
+        return false;
+    }
+
+    // the iterations left, every one of them updates the counter once
+    Induction counter = loop->inductions[loop->counter];
+    int64_t start = state->registers[counter.reg];
+    int64_t step = wrap(state, counter.step);
+    int64_t bound = eval_int(state, loop->bound);
+    int64_t distance;
+    if (loop->exit == OP_JUMPL && step > 0) {
+        if (__builtin_sub_overflow(bound, start, &distance)) {
+            return false;
+        }
+    } else if (loop->exit == OP_JUMPG && step < 0 && step != INT64_MIN) {
+        if (__builtin_sub_overflow(start, bound, &distance)) {
+            return false;
+        }
+        step = -step;
+    } else {
+        return false;
+    }
+    size_t count =
+        (distance <= step) ? 1 : distance / step + (distance % step != 0);
+    if (count > MEMORY_SIZE / WORD_WIDTH) {
+        return false;
+    }
+
+    // the counter must not wrap around before the last comparison
+    int64_t last;
+    if (__builtin_mul_overflow((int64_t)count, wrap(state, counter.step),
+                               &last) ||
+        __builtin_add_overflow(start, last, &last) ||
+        last != wrap(state, last)) {
+        return false;
+    }
+
+    // the slice ends with the iteration that reaches its deadline, the same
+    // as when the loop is interpreted
+    size_t length = loop->end - loop->start + 1;
+    size_t left =
+        (state->deadline > state->retired) ? state->deadline - state->retired
+                                           : 0;
+    size_t runs = left / length + (left % length != 0);
+    if (runs == 0) {
+        return false;
+    }
+    bool done = runs >= count;
+    if (!done) {
+        count = runs;
+        last = start + (int64_t)count * wrap(state, counter.step);
+    }
+
+    size_t size = count * WORD_WIDTH;
+    int64_t dst = 0, src = 0;
+    if (loop->kind != LOOP_SUM) {
+        dst = loop_address(state, loop->inductions[loop->dst]);
+        if (!in_memory(dst, count) ||
+            (state->mappings.size && find_read_only(state, dst, size))) {
+            return false;
+        }
+    }
+    if (loop->kind != LOOP_FILL) {
+        src = loop_address(state, loop->inductions[loop->src]);
+        if (!in_memory(src, count)) {
+            return false;
+        }
+    }
+
+    unsigned char *memory = state->memory;
+    switch (loop->kind) {
+    case LOOP_FILL: {
+        uint32_t word = eval_int(state, loop->value);
+        uint8_t byte = word;
+        if (word == byte * 0x01010101u) {
+            memset(&memory[dst], byte, size);
+        } else {
+            for (size_t i = 0; i < size; i += WORD_WIDTH) {
+                memcpy(&memory[dst + i], &word, WORD_WIDTH);
+            }
+        }
+    } break;
+    case LOOP_COPY:
+        if (dst <= src || dst >= src + (int64_t)size) {
+            memmove(&memory[dst], &memory[src], size);
+        } else {
+            // a copy to a higher overlapping address reads words that it
+            // already wrote, so it has to go in the same order
+            for (size_t i = 0; i < size; i += WORD_WIDTH) {
+                uint32_t word;
+                memcpy(&word, &memory[src + i], WORD_WIDTH);
+                memcpy(&memory[dst + i], &word, WORD_WIDTH);
+            }
+        }
+        break;
+    case LOOP_SUM: {
+        uint64_t sum = state->registers[loop->acc];
+        for (size_t i = 0; i < size; i += WORD_WIDTH) {
+            int32_t word;
+            memcpy(&word, &memory[src + i], WORD_WIDTH);
+            sum += (uint64_t)(int64_t)word;
+        }
+        state->registers[loop->acc] = wrap(state, sum);
+    } break;
+    }
+
+    for (int i = 0; i < loop->induction_count; i++) {
+        Induction induction = loop->inductions[i];
+        uint64_t value = state->registers[induction.reg] +
+                         count * (uint64_t)wrap(state, induction.step);
+        state->registers[induction.reg] = wrap(state, value);
+    }
+    state->flag_cmp = (last < bound) ? -1 : (last > bound) ? +1 : 0;
+    state->reg_pc = done ? loop->end + 1 : loop->start;
+    state->retired += count * length;
+    return true;
+}
+
+// takes a jump and runs the loop it closes natively if there is one, the jump
+// is the opcode before `reg_pc`
+static inline void take_jump(State *state, OpCode *opcode) {
+    size_t at = state->reg_pc - 1;
+    state->reg_pc = opcode->operands[0].value;
+    const Loops *loops = state->loops;
+    if (loops && loops->closed_by && at < loops->opcodes &&
+        loops->closed_by[at]) {
+        run_loop(state, &loops->data[loops->closed_by[at] - 1]);
     }
 }
 
@@ -108,25 +515,38 @@ bool execute_opcode(State *state, OpCode *opcode) {
         }
     } break;
     case OP_MOVE: {
-        int first = eval_int(state, opcode->operands[1]);
+        int64_t first = eval_int(state, opcode->operands[1]);
         if (!set_lval(state, opcode, first)) {
             return false;
         }
     } break;
-    case OP_LOAD: {
-        int index = eval_int(state, opcode->operands[1]);
-        int first = *(int *)(&state->memory[index]);
+    case OP_LOAD:
+    case OP_LOADB:
+    case OP_LOADH:
+    case OP_LOADW:
+    case OP_LOADQ: {
+        int64_t index = eval_int(state, opcode->operands[1]);
+        int64_t first = mem_read(state, index, OPCODES[opcode->op].width);
         if (!set_lval(state, opcode, first)) {
             return false;
         }
     } break;
-    case OP_STORE: {
-        int index = eval_int(state, opcode->operands[0]);
-        *(int *)(&state->memory[index]) = opcode->operands[1].value;
+    case OP_STORE:
+    case OP_STOREB:
+    case OP_STOREH:
+    case OP_STOREW:
+    case OP_STOREQ: {
+        int width = OPCODES[opcode->op].width;
+        int64_t index = eval_int(state, opcode->operands[0]);
+        int64_t value = eval_int(state, opcode->operands[1]);
+        if (!CHECK_WRITABLE(state, opcode, index, width)) {
+            return false;
+        }
+        mem_write(state, index, width, value);
     } break;
     case OP_CMP: {
-        int first = eval_int(state, opcode->operands[0]);
-        int second = eval_int(state, opcode->operands[1]);
+        int64_t first = eval_int(state, opcode->operands[0]);
+        int64_t second = eval_int(state, opcode->operands[1]);
         state->flag_cmp = (first < second) ? -1 : (first > second) ? +1 : 0;
     } break;
     case OP_JUMP: {
@@ -139,22 +559,22 @@ bool execute_opcode(State *state, OpCode *opcode) {
     } break;
     case OP_JUMPG: {
         if (state->flag_cmp == 1) {
-            state->reg_pc = opcode->operands[0].value;
+            take_jump(state, opcode);
         }
     } break;
     case OP_JUMPL: {
         if (state->flag_cmp == -1) {
-            state->reg_pc = opcode->operands[0].value;
+            take_jump(state, opcode);
         }
     } break;
     case OP_PUSH: {
-        int first = eval_int(state, opcode->operands[0]);
+        int64_t first = eval_int(state, opcode->operands[0]);
         state->stack[state->reg_sp] = first;
         state->reg_sp = (state->reg_sp + 1) % STACK_MAX;
     } break;
     case OP_POP: {
         state->reg_sp = MODULO(state->reg_sp - 1, STACK_MAX);
-        int value = state->stack[state->reg_sp];
+        int64_t value = state->stack[state->reg_sp];
         if (!set_lval(state, opcode, value)) {
             return false;
         }
@@ -164,9 +584,14 @@ bool execute_opcode(State *state, OpCode *opcode) {
     } break;
     case OP_PRINTLN: {
         execute_print(state, opcode->operands[0]);
-        putchar('\n');
+        if (state->output) {
+            output_write(state->output, "\n", 1);
+        } else {
+            putchar('\n');
+        }
     } break;
     case OP_NO:
+    case OP_YIELD:
         break;
     default:
         assert(false && "Unreachable");
@@ -175,11 +600,55 @@ bool execute_opcode(State *state, OpCode *opcode) {
 }
 
 bool interpret(State *state, OpCodes opcodes) {
+    state->deadline = SIZE_MAX;
     while (state->reg_pc < opcodes.size) {
         OpCode op = opcodes.data[state->reg_pc++];
+        state->retired++;
         if (!execute_opcode(state, &op)) {
             return false;
         }
     }
     return true;
 }
+
+// most bytes that a print opcode can output
+size_t print_size(OpCode *opcode) {
+    size_t size = (opcode->op == OP_PRINTLN) ? 1 : 0;
+    Operand operand = opcode->operands[0];
+    switch (operand.type) {
+    case TOK_LITERAL_CHAR:
+        return size + 1;
+    case TOK_LITERAL_STR:
+        return size + operand.string.length;
+    default:
+        return size + 20; // digits of INT64_MIN along with the sign
+    }
+}
+
+// Runs the program until it ends, yields, has to wait for its output to be
+// flushed or has executed at least `quantum` opcodes. The quantum is only
+// checked at the jumps that end basic blocks, which keeps the check out of
+// straight line code.
+RunStatus interpret_slice(State *state, OpCodes opcodes, size_t quantum) {
+    size_t deadline = state->retired + quantum;
+    state->deadline = deadline;
+    while (state->reg_pc < opcodes.size) {
+        OpCode *op = &opcodes.data[state->reg_pc];
+        if ((op->op == OP_PRINT || op->op == OP_PRINTLN) && state->output &&
+            state->output->size + print_size(op) > state->output->capacity) {
+            return RUN_BLOCKED;
+        }
+        state->reg_pc++;
+        state->retired++;
+        if (op->op == OP_YIELD) {
+            return RUN_YIELD;
+        }
+        if (!execute_opcode(state, op)) {
+            return RUN_ERROR;
+        }
+        if (is_jump(op->op) && state->retired >= deadline) {
+            return RUN_PREEMPTED;
+        }
+    }
+    return RUN_DONE;
+}
@@ -2,25 +2,69 @@
 #define BASS_INTERPRETER_H
 
 #include "constants.h"
+#include "loops.h"
+#include "memtrace.h"
 #include "parser.h"
 
+// host file mapped into the VM memory with `--map FILE@ADDR[:ro|rw]`
 typedef struct {
-    int registers[REG_COUNT];
-    int stack[STACK_MAX];
+    const char *path;
+    size_t addr;   // offset into the VM memory (page aligned)
+    size_t length; // size of the file in bytes
+    bool writable; // writes go back to the file when set
+} Mapping;
+
+typedef struct {
+    Mapping *data;
+    size_t size;
+    size_t capacity;
+} Mappings;
+
+// buffered output of a VM run by the scheduler
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} Output;
+
+// the stack comes last so that the other fields share a page, which matters
+// when there are many states
+typedef struct {
+    int64_t registers[REG_COUNT];
     int reg_sp;    // stack pointer register
     size_t reg_pc; // program counter register (stores next op index)
     int flag_cmp;  // -1, 0, 1 depending on last cmp operation
+    size_t retired; // no of opcodes executed so far
+    size_t deadline; // `retired` at which the current slice ends
+    bool wide;      // 64-bit registers, otherwise values wrap at 32 bits
+    MemTrace *trace; // records memory accesses when set
+    Output *output;  // prints go here instead of stdout when set
+    const Loops *loops; // loops that are run natively, see `find_loops`
     unsigned char *memory;
+    Mappings mappings;
+    int64_t stack[STACK_MAX];
 } State;
 
-static inline bool state_init(State *state) {
-    memset(state, 0, sizeof(*state));
-    state->memory = calloc(MEMORY_SIZE, sizeof(state->memory[0]));
-    if (!state->memory) {
-        return false;
-    }
-    return true;
+// reasons for `interpret_slice` to return
+typedef enum {
+    RUN_DONE,
+    RUN_ERROR,
+    RUN_YIELD,     // executed a `yield`
+    RUN_PREEMPTED, // used up its quantum
+    RUN_BLOCKED,   // the next print doesnt fit into the output
+} RunStatus;
+
+// values wrap around at 32 bits unless running with 64-bit registers
+static inline int64_t wrap(const State *state, int64_t value) {
+    return state->wide ? value : (int32_t)value;
 }
 
+bool state_init(State *state);
+void state_free(State *state);
+void state_reset(State *state);
+void state_load_image(State *state, DataSegments data);
+bool state_map_file(State *state, Mapping mapping);
 bool interpret(State *state, OpCodes opcodes);
+size_t print_size(OpCode *opcode);
+RunStatus interpret_slice(State *state, OpCodes opcodes, size_t quantum);
 #endif
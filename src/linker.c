@@ -0,0 +1,510 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "linker.h"
+#include "parser.h"
+#include "utils.h"
+
+// Open addressing table over the labels of a module. Only the first of
+// several labels with the same name can be found.
+typedef struct {
+    Labels labels;
+    size_t *slots; // index of the label plus one, 0 when the slot is empty
+    size_t mask;
+} LabelTable;
+
+static size_t label_slot(LabelTable *table, StringView name) {
+    size_t slot = string_view_hash(name) & table->mask;
+    while (table->slots[slot] &&
+           !string_view_eq(table->labels.data[table->slots[slot] - 1].name,
+                           name)) {
+        slot = (slot + 1) & table->mask;
+    }
+    return slot;
+}
+
+static void label_table_init(LabelTable *table, Labels labels) {
+    size_t capacity = 16;
+    while (capacity < labels.size * 2) {
+        capacity *= 2;
+    }
+    table->labels = labels;
+    table->slots = calloc(capacity, sizeof(size_t));
+    assert(table->slots && "Catastrophic Failure: Allocation failed!");
+    table->mask = capacity - 1;
+    for (size_t i = 0; i < labels.size; i++) {
+        size_t slot = label_slot(table, labels.data[i].name);
+        if (!table->slots[slot]) {
+            table->slots[slot] = i + 1;
+        }
+    }
+}
+
+static bool find_label(LabelTable *table, StringView name, Label **label) {
+    size_t slot = label_slot(table, name);
+    if (!table->slots[slot]) {
+        return false;
+    }
+    *label = &table->labels.data[table->slots[slot] - 1];
+    return true;
+}
+
+// marks the exported labels and points the jumps at the labels of the module
+static bool module_resolve(Module *module) {
+    Parser *parser = &module->parser;
+    LabelTable table;
+    label_table_init(&table, module->labels);
+    for (size_t i = 0; i < parser->exports.size; i++) {
+        Export export = parser->exports.data[i];
+        Label *label;
+        if (!find_label(&table, export.name, &label)) {
+            fprintf(stderr,
+                    "bass: exported label `%.*s` is not defined at: %s:%d\n",
+                    SV_FORMAT(export.name), module->name, export.line);
+            free(table.slots);
+            return false;
+        }
+        label->exported = true;
+    }
+
+    for (size_t i = 0; i < module->opcodes.size; i++) {
+        OpCode *opcode = &module->opcodes.data[i];
+        if (!is_jump(opcode->op)) {
+            continue;
+        }
+        Relocation relocation = {i, false};
+        Label *label;
+        if (find_label(&table, opcode->operands[0].string, &label)) {
+            opcode->operands[0].value = label->index;
+        } else {
+            relocation.external = true;
+        }
+        arena_dyn_append(&parser->arena, &module->relocations, relocation);
+    }
+    free(table.slots);
+    return true;
+}
+
+static bool module_compile(ModuleCache *cache, Module *module,
+                           size_t length) {
+    Parser *parser = &module->parser;
+    parser_init(parser, (StringView){module->source, length});
+    parser->root = cache->root;
+    if (!parse_parallel(parser, &module->opcodes, &module->labels,
+                        cache->jobs)) {
+        return false;
+    }
+    return module_resolve(module);
+}
+
+Module *module_from_source(ModuleCache *cache, const char *name, char *source,
+                           size_t length) {
+    Module *module = calloc(1, sizeof(Module));
+    assert(module && "Catastrophic Failure: Allocation failed!");
+    module->name = strdup(name);
+    module->source = source;
+    if (!module_compile(cache, module, length)) {
+        module_free(module);
+        return NULL;
+    }
+    return module;
+}
+
+Module *module_edit(ModuleCache *cache, Module *old, char *source,
+                    size_t length, bool *spliced) {
+    Module *module = calloc(1, sizeof(Module));
+    assert(module && "Catastrophic Failure: Allocation failed!");
+    module->name = strdup(old->name);
+    module->source = source;
+    Parser *parser = &module->parser;
+    parser_init(parser, (StringView){source, length});
+    parser->root = cache->root;
+    *spliced = parse_edit(parser, &module->opcodes, &module->labels,
+                          &old->parser, old->opcodes, old->labels);
+    if (!*spliced) {
+        parser_free(parser);
+        module->opcodes = (OpCodes){0};
+        module->labels = (Labels){0};
+    }
+    bool ok = *spliced ? module_resolve(module)
+                       : module_compile(cache, module, length);
+    if (!ok) {
+        module_free(module);
+        return NULL;
+    }
+    return module;
+}
+
+void module_free(Module *module) {
+    parser_free(&module->parser);
+    free(module->deps.data);
+    free(module->source);
+    free(module->path);
+    free(module->name);
+    free(module);
+}
+
+static bool module_changed(Module *module, struct stat *st) {
+    return module->device != st->st_dev || module->inode != st->st_ino ||
+           module->file_size != st->st_size ||
+           module->mtime.tv_sec != st->st_mtim.tv_sec ||
+           module->mtime.tv_nsec != st->st_mtim.tv_nsec;
+}
+
+Module *module_load(ModuleCache *cache, const char *path) {
+    char *canonical = realpath(path, NULL);
+    struct stat st;
+    if (!canonical || stat(canonical, &st) < 0) {
+        fprintf(stderr, "bass: failed to open `%s`: %s\n", path,
+                strerror(errno));
+        free(canonical);
+        return NULL;
+    }
+    if (cache->root && !path_inside(cache->root, canonical)) {
+        fprintf(stderr, "bass: `%s` is outside of `%s`\n", path, cache->root);
+        free(canonical);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < cache->modules.size; i++) {
+        Module *module = cache->modules.data[i];
+        if (strcmp(module->path, canonical) != 0) {
+            continue;
+        }
+        // a module is only checked once per link so that it cant change
+        // while it is being used
+        if (module->loaded == cache->epoch || !module_changed(module, &st)) {
+            module->loaded = cache->epoch;
+            free(canonical);
+            return module;
+        }
+        module_free(module);
+        cache->modules.data[i] =
+            cache->modules.data[--cache->modules.size];
+        break;
+    }
+
+    StringView source;
+    if (!read_to_string(canonical, &source)) {
+        free(canonical);
+        return NULL;
+    }
+    Module *module =
+        module_from_source(cache, path, (char *)source.data, source.length);
+    if (!module) {
+        free(canonical);
+        return NULL;
+    }
+    module->path = canonical;
+    module->device = st.st_dev;
+    module->inode = st.st_ino;
+    module->file_size = st.st_size;
+    module->mtime = st.st_mtim;
+    module->loaded = cache->epoch;
+    dyn_append(&cache->modules, module);
+    return module;
+}
+
+void module_cache_free(ModuleCache *cache) {
+    for (size_t i = 0; i < cache->modules.size; i++) {
+        module_free(cache->modules.data[i]);
+    }
+    free(cache->modules.data);
+    cache->modules = (ModuleList){0};
+}
+
+void program_free(Program *program) {
+    loops_free(&program->loops);
+    arena_free(&program->arena);
+    *program = (Program){0};
+}
+
+// exported label and the module that exports it
+typedef struct {
+    StringView name;
+    size_t index;
+    Module *module;
+} Symbol;
+
+typedef struct {
+    Symbol *data;
+    size_t size;
+    size_t capacity;
+} Symbols;
+
+// copy of a module's code in the program
+typedef struct {
+    Module *module;
+    size_t base;
+} Placement;
+
+typedef struct {
+    Placement *data;
+    size_t size;
+    size_t capacity;
+} Placements;
+
+typedef struct {
+    ModuleCache *cache;
+    Program *program;
+    ModuleList units; // modules placed one after another, starting with main
+    Placements placements;
+    Symbols symbols;
+} Linker;
+
+char *module_import_path(Module *module, StringView path) {
+    const char *slash = strrchr(module->name, '/');
+    size_t dir_length = (slash && path.data[0] != '/')
+                            ? (size_t)(slash - module->name + 1)
+                            : 0;
+    char *result = malloc(dir_length + path.length + 1);
+    assert(result && "Catastrophic Failure: Allocation failed!");
+    memcpy(result, module->name, dir_length);
+    memcpy(&result[dir_length], path.data, path.length);
+    result[dir_length + path.length] = '\0';
+    return result;
+}
+
+static bool is_unit(Linker *linker, Module *module) {
+    for (size_t i = 0; i < linker->units.size; i++) {
+        if (linker->units.data[i] == module) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// loads every module that `module` imports or includes
+static bool collect(Linker *linker, Module *module) {
+    unsigned epoch = linker->cache->epoch;
+    if (module->collected == epoch) {
+        return true;
+    }
+    module->collected = epoch;
+    module->deps.size = 0;
+
+    Imports imports = module->parser.imports;
+    for (size_t i = 0; i < imports.size; i++) {
+        Import import = imports.data[i];
+        char *path = module_import_path(module, import.path);
+        Module *dep = module_load(linker->cache, path);
+        free(path);
+        if (!dep) {
+            fprintf(stderr, "bass: failed to import `%.*s` at: %s:%d\n",
+                    SV_FORMAT(import.path), module->name, import.line);
+            return false;
+        }
+        dyn_append(&module->deps, dep);
+        if (!import.inline_copy && !is_unit(linker, dep)) {
+            dyn_append(&linker->units, dep);
+        }
+        if (!collect(linker, dep)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compute_size(Linker *linker, Module *module) {
+    if (module->sized == linker->cache->epoch) {
+        return true;
+    }
+    module->including = true;
+    size_t size = module->opcodes.size;
+    Imports imports = module->parser.imports;
+    for (size_t i = 0; i < imports.size; i++) {
+        if (!imports.data[i].inline_copy) {
+            continue;
+        }
+        Module *dep = module->deps.data[i];
+        if (dep->including) {
+            fprintf(stderr, "bass: `%s` ends up including itself at: %s:%d\n",
+                    dep->name, module->name, imports.data[i].line);
+            module->including = false;
+            return false;
+        }
+        if (!compute_size(linker, dep)) {
+            module->including = false;
+            return false;
+        }
+        size += dep->size;
+    }
+    module->including = false;
+    module->size = size;
+    module->sized = linker->cache->epoch;
+    return true;
+}
+
+// index in the program of the opcode at `index` in a module placed at `base`,
+// every `.include` before it moves it further down
+static size_t rebase(Module *module, size_t base, size_t index) {
+    size_t result = base + index;
+    Imports imports = module->parser.imports;
+    for (size_t i = 0; i < imports.size && imports.data[i].index < index;
+         i++) {
+        if (imports.data[i].inline_copy) {
+            result += module->deps.data[i]->size;
+        }
+    }
+    return result;
+}
+
+static bool place(Linker *linker, Module *module, size_t base) {
+    Program *program = linker->program;
+    Placement placement = {module, base};
+    dyn_append(&linker->placements, placement);
+
+    Imports imports = module->parser.imports;
+    size_t shift = 0;
+    size_t next_import = 0;
+    for (size_t i = 0; i < module->opcodes.size; i++) {
+        program->opcodes.data[base + i + shift] = module->opcodes.data[i];
+        for (; next_import < imports.size &&
+               imports.data[next_import].index == i;
+             next_import++) {
+            if (imports.data[next_import].inline_copy) {
+                Module *dep = module->deps.data[next_import];
+                if (!place(linker, dep, base + i + shift + 1)) {
+                    return false;
+                }
+                shift += dep->size;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < module->labels.size; i++) {
+        Label label = module->labels.data[i];
+        label.index = rebase(module, base, label.index);
+        arena_dyn_append(&program->arena, &program->labels, label);
+        if (!label.exported) {
+            continue;
+        }
+        for (size_t j = 0; j < linker->symbols.size; j++) {
+            Symbol symbol = linker->symbols.data[j];
+            if (string_view_eq(symbol.name, label.name)) {
+                fprintf(stderr,
+                        "bass: label `%.*s` is exported by both `%s` and "
+                        "`%s`\n",
+                        SV_FORMAT(label.name), symbol.module->name,
+                        module->name);
+                return false;
+            }
+        }
+        Symbol symbol = {label.name, label.index, module};
+        dyn_append(&linker->symbols, symbol);
+    }
+
+    DataSegments data = module->parser.data;
+    for (size_t i = 0; i < data.size; i++) {
+        arena_dyn_append(&program->arena, &program->data, data.data[i]);
+    }
+    return true;
+}
+
+static void report_unresolved(Module *module, size_t index) {
+    OpCode opcode = module->opcodes.data[index];
+    fprintf(stderr, "bass: couldnt find label: `%.*s` at: %s:%d:%zu\n",
+            SV_FORMAT(opcode.operands[0].string), module->name, opcode.line,
+            opcode.col);
+}
+
+// points the jumps of every placed module at their targets in the program
+static bool relocate(Linker *linker) {
+    Program *program = linker->program;
+    for (size_t i = 0; i < linker->placements.size; i++) {
+        Placement placement = linker->placements.data[i];
+        Module *module = placement.module;
+        for (size_t j = 0; j < module->relocations.size; j++) {
+            Relocation relocation = module->relocations.data[j];
+            size_t at = rebase(module, placement.base, relocation.opcode);
+            Operand *target = &program->opcodes.data[at].operands[0];
+            if (!relocation.external) {
+                target->value = rebase(module, placement.base, target->value);
+                continue;
+            }
+            bool found = false;
+            for (size_t k = 0; k < linker->symbols.size; k++) {
+                if (string_view_eq(linker->symbols.data[k].name,
+                                   target->string)) {
+                    target->value = linker->symbols.data[k].index;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                report_unresolved(module, relocation.opcode);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool link_modules(Linker *linker, Module *main) {
+    Program *program = linker->program;
+    dyn_append(&linker->units, main);
+    if (!collect(linker, main)) {
+        return false;
+    }
+
+    // a module without imports is already linked
+    if (main->parser.imports.size == 0) {
+        for (size_t i = 0; i < main->relocations.size; i++) {
+            if (main->relocations.data[i].external) {
+                report_unresolved(main, main->relocations.data[i].opcode);
+                return false;
+            }
+        }
+        program->opcodes = main->opcodes;
+        program->labels = main->labels;
+        program->data = main->parser.data;
+        return true;
+    }
+
+    size_t total = linker->units.size - 1;
+    for (size_t i = 0; i < linker->units.size; i++) {
+        if (!compute_size(linker, linker->units.data[i])) {
+            return false;
+        }
+        total += linker->units.data[i]->size;
+    }
+    arena_dyn_reserve(&program->arena, &program->opcodes, total + 1);
+    program->opcodes.size = total;
+
+    size_t base = 0;
+    for (size_t i = 0; i < linker->units.size; i++) {
+        Module *unit = linker->units.data[i];
+        if (!place(linker, unit, base)) {
+            return false;
+        }
+        base += unit->size;
+        if (i + 1 < linker->units.size) {
+            // jumping past the last opcode ends the program
+            Operand end = {TOK_LABEL, total, {"end", 3}};
+            program->opcodes.data[base++] = (OpCode){0, OP_JUMP, 0, {end}};
+        }
+    }
+    return relocate(linker);
+}
+
+bool link_program(ModuleCache *cache, Module *main, Program *program) {
+    *program = (Program){0};
+    cache->epoch++;
+    main->loaded = cache->epoch;
+    Linker linker = {.cache = cache, .program = program};
+    bool ok = link_modules(&linker, main);
+    free(linker.units.data);
+    free(linker.placements.data);
+    free(linker.symbols.data);
+    if (!ok) {
+        program_free(program);
+        return false;
+    }
+    find_loops(program->opcodes, &program->loops);
+    return true;
+}
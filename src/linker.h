@@ -0,0 +1,103 @@
+#ifndef BASS_LINKER_H
+#define BASS_LINKER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "loops.h"
+#include "parser.h"
+
+// jump opcode whose target has to be adjusted when the module gets linked
+typedef struct {
+    size_t opcode;
+    bool external; // label isnt defined in the module, resolved by name
+} Relocation;
+
+typedef struct {
+    Relocation *data;
+    size_t size;
+    size_t capacity;
+} Relocations;
+
+struct Module;
+
+typedef struct {
+    struct Module **data;
+    size_t size;
+    size_t capacity;
+} ModuleList;
+
+// A parsed module where the jumps to its own labels hold indices relative to
+// the start of the module and jumps to labels of other modules are left
+// unresolved. Modules are compiled once and can then be linked into any
+// number of programs.
+typedef struct Module {
+    char *name; // path as it was given, used in errors
+    char *path; // canonical path, NULL for sources that arent read from files
+    char *source;
+    dev_t device; // identify the file that `source` was read from
+    ino_t inode;
+    off_t file_size;
+    struct timespec mtime;
+    Parser parser; // owns the opcodes, labels and relocations
+    OpCodes opcodes;
+    Labels labels;
+    Relocations relocations;
+
+    // used while linking, the epochs are those of the last link that loaded,
+    // collected the imports of and sized the module
+    unsigned loaded;
+    unsigned collected;
+    unsigned sized;
+    ModuleList deps; // parallel to `parser.imports`
+    size_t size;     // number of opcodes with every `.include` placed inline
+    bool including;
+} Module;
+
+// compiled modules by canonical path, modules whose files have changed since
+// they were compiled are compiled again when they are next linked
+typedef struct {
+    ModuleList modules;
+    unsigned epoch;
+    int jobs; // threads used to parse the modules
+    // canonical path of the directory that modules and the files of their
+    // directives have to be in, NULL to allow any
+    const char *root;
+} ModuleCache;
+
+// output of the linker, the opcodes point into the sources of the modules
+// so they have to outlive it
+typedef struct {
+    OpCodes opcodes;
+    Labels labels; // every label of every module, for `--debug`
+    DataSegments data;
+    Loops loops; // see `find_loops`
+    Arena arena;
+} Program;
+
+// Compiles `source` with the settings of `cache`, without adding it to the
+// cache. Takes ownership of `source`, `name` is copied.
+Module *module_from_source(ModuleCache *cache, const char *name, char *source,
+                           size_t length);
+// Compiles the edited `source` of `old`, taking ownership of it. Only the
+// lines around the edit are parsed again when possible, `spliced` tells
+// whether that was the case. `old` is left as it is.
+Module *module_edit(ModuleCache *cache, Module *old, char *source,
+                    size_t length, bool *spliced);
+Module *module_load(ModuleCache *cache, const char *path);
+void module_free(Module *module);
+// Path of a file imported by `module`, relative to the directory of the
+// module. The result has to be freed.
+char *module_import_path(Module *module, StringView path);
+void module_cache_free(ModuleCache *cache);
+
+// Places `main` first, followed by every module that it imports directly or
+// indirectly, with a jump to the end of the program in between so that
+// execution never runs off into an imported module. Exported labels are
+// global and must be unique while other labels can only be used inside
+// their own module. The loops of the linked program are found last.
+bool link_program(ModuleCache *cache, Module *main, Program *program);
+void program_free(Program *program);
+
+#endif
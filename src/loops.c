@@ -0,0 +1,219 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "loops.h"
+#include "parser.h"
+#include "utils.h"
+
+// `@rN` operands access a word, so the addresses have to move by one
+#define LOOP_STRIDE 4
+
+static inline bool is_value(Operand operand) {
+    return operand.type == TOK_LITERAL_NUM || operand.type == TOK_REGISTER;
+}
+
+static int find_induction(Loop *loop, int64_t reg) {
+    for (int i = 0; i < loop->induction_count; i++) {
+        if (loop->inductions[i].reg == reg) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// finds the induction holding an address, which has to move a word at a time
+static bool find_pointer(Loop *loop, int64_t reg, int *index) {
+    *index = find_induction(loop, reg);
+    return *index >= 0 && loop->inductions[*index].step == LOOP_STRIDE;
+}
+
+// checks whether the jump at `end` closes a loop that can be run natively
+static bool analyze_loop(OpCodes opcodes, size_t end, Loop *loop) {
+    OpCode *jump = &opcodes.data[end];
+    size_t start = jump->operands[0].value;
+    // the body needs at least the memory access and the `cmp`
+    if (start >= end || end - start < 2) {
+        return false;
+    }
+    OpCode *cmp = &opcodes.data[end - 1];
+    if (cmp->op != OP_CMP || cmp->operands[0].type != TOK_REGISTER ||
+        !is_value(cmp->operands[1])) {
+        return false;
+    }
+
+    memset(loop, 0, sizeof(*loop));
+    loop->start = start;
+    loop->end = end;
+    loop->exit = jump->op;
+    int writes[REG_COUNT] = {0};
+    int64_t dst = -1, src = -1;
+    bool access = false;
+    for (size_t i = start; i < end - 1; i++) {
+        OpCode *op = &opcodes.data[i];
+        Operand *operands = op->operands;
+        switch (op->op) {
+        case OP_NO:
+            break;
+        case OP_ADD:
+        case OP_SUB: {
+            if (operands[0].type != TOK_REGISTER) {
+                return false;
+            }
+            // a register written twice could end up as an induction and
+            // the accumulator at the same time
+            int64_t reg = operands[0].value;
+            if (writes[reg]++) {
+                return false;
+            }
+            if (operands[1].type == TOK_REGISTER && operands[1].value == reg &&
+                operands[2].type == TOK_LITERAL_NUM) {
+                uint64_t step = operands[2].value;
+                Induction induction = {reg,
+                                       (op->op == OP_ADD) ? (int64_t)step
+                                                          : (int64_t)-step,
+                                       !access};
+                loop->inductions[loop->induction_count++] = induction;
+            } else if (op->op == OP_ADD && !access &&
+                       operands[1].type == TOK_REGISTER &&
+                       operands[1].value == reg &&
+                       operands[2].type == TOK_ADDRESS_REG) {
+                loop->kind = LOOP_SUM;
+                loop->acc = reg;
+                src = operands[2].value;
+                access = true;
+            } else if (op->op == OP_ADD && !access &&
+                       operands[2].type == TOK_REGISTER &&
+                       operands[2].value == reg &&
+                       operands[1].type == TOK_ADDRESS_REG) {
+                loop->kind = LOOP_SUM;
+                loop->acc = reg;
+                src = operands[1].value;
+                access = true;
+            } else {
+                return false;
+            }
+        } break;
+        case OP_MOVE:
+            if (access || operands[0].type != TOK_ADDRESS_REG) {
+                return false;
+            }
+            dst = operands[0].value;
+            if (operands[1].type == TOK_ADDRESS_REG) {
+                loop->kind = LOOP_COPY;
+                src = operands[1].value;
+            } else if (is_value(operands[1])) {
+                loop->kind = LOOP_FILL;
+                loop->value = operands[1];
+            } else {
+                return false;
+            }
+            access = true;
+            break;
+        case OP_STORE:
+        case OP_STOREW:
+            if (access || operands[0].type != TOK_REGISTER ||
+                !is_value(operands[1])) {
+                return false;
+            }
+            loop->kind = LOOP_FILL;
+            dst = operands[0].value;
+            loop->value = operands[1];
+            access = true;
+            break;
+        default:
+            return false;
+        }
+    }
+    if (!access) {
+        return false;
+    }
+
+    // everything else has to stay the same for the whole loop
+    if (loop->kind == LOOP_FILL && loop->value.type == TOK_REGISTER &&
+        writes[loop->value.value]) {
+        return false;
+    }
+    if (cmp->operands[1].type == TOK_REGISTER &&
+        writes[cmp->operands[1].value]) {
+        return false;
+    }
+    loop->bound = cmp->operands[1];
+    loop->counter = find_induction(loop, cmp->operands[0].value);
+    if (loop->counter < 0) {
+        return false;
+    }
+    if (loop->kind != LOOP_SUM && !find_pointer(loop, dst, &loop->dst)) {
+        return false;
+    }
+    if (loop->kind != LOOP_FILL && !find_pointer(loop, src, &loop->src)) {
+        return false;
+    }
+    return true;
+}
+
+void find_loops(OpCodes opcodes, Loops *loops) {
+    for (size_t i = 0; i < opcodes.size; i++) {
+        OpType op = opcodes.data[i].op;
+        Loop loop;
+        if ((op != OP_JUMPL && op != OP_JUMPG) ||
+            !analyze_loop(opcodes, i, &loop)) {
+            continue;
+        }
+        if (!loops->closed_by) {
+            loops->closed_by = calloc(opcodes.size, sizeof(size_t));
+            assert(loops->closed_by &&
+                   "Catastrophic Failure: Allocation failed!");
+            loops->opcodes = opcodes.size;
+        }
+        dyn_append(loops, loop);
+        loops->closed_by[i] = loops->size;
+    }
+}
+
+void loops_free(Loops *loops) {
+    free(loops->data);
+    free(loops->closed_by);
+    *loops = (Loops){0};
+}
+
+static void display_value(Operand operand) {
+    if (operand.type == TOK_REGISTER) {
+        printf("r%" PRId64, operand.value);
+    } else {
+        printf("#%" PRId64, operand.value);
+    }
+}
+
+void display_loops(Loops loops, OpCodes opcodes) {
+    for (size_t i = 0; i < loops.size; i++) {
+        Loop loop = loops.data[i];
+        printf("Loop: %s (opcodes %zu to %zu, lines %d to %d)\n",
+               LOOP_STRING[loop.kind], loop.start, loop.end,
+               opcodes.data[loop.start].line, opcodes.data[loop.end].line);
+        switch (loop.kind) {
+        case LOOP_FILL:
+            printf("\tSTORE: ");
+            display_value(loop.value);
+            printf(" at r%d\n", loop.inductions[loop.dst].reg);
+            break;
+        case LOOP_COPY:
+            printf("\tCOPY: from r%d to r%d\n", loop.inductions[loop.src].reg,
+                   loop.inductions[loop.dst].reg);
+            break;
+        case LOOP_SUM:
+            printf("\tSUM: of r%d into r%d\n", loop.inductions[loop.src].reg,
+                   loop.acc);
+            break;
+        }
+        Induction counter = loop.inductions[loop.counter];
+        printf("\tCOUNTER: r%d (step %" PRId64 ") while %s ", counter.reg,
+               counter.step,
+               (loop.exit == OP_JUMPL) ? "less than" : "greater than");
+        display_value(loop.bound);
+        printf("\n");
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef BASS_LOOPS_H
+#define BASS_LOOPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "parser.h"
+
+typedef enum {
+    LOOP_FILL, // stores the same word into consecutive words
+    LOOP_COPY, // copies consecutive words
+    LOOP_SUM,  // adds up consecutive words into a register
+} LoopKind;
+
+static const char *const LOOP_STRING[LOOP_SUM + 1] = {
+    [LOOP_FILL] = "fill",
+    [LOOP_COPY] = "copy",
+    [LOOP_SUM] = "sum",
+};
+
+// register that is changed by the same amount in every iteration
+typedef struct {
+    int reg;
+    int64_t step;      // literal, wrapped at runtime like any other literal
+    bool before_access; // updated before the memory access of the iteration
+} Induction;
+
+// A loop made out of a single basic block that ends with `cmp` and `jumpl`
+// (or `jumpg`) back to its start, which accesses one word per iteration
+// through registers that move by a word every iteration. The rest of such a
+// loop only updates induction registers, so it can be run natively once its
+// trip count is known.
+typedef struct {
+    LoopKind kind;
+    size_t start; // index of the first opcode of the body
+    size_t end;   // index of the jump that closes the loop
+    Induction inductions[REG_COUNT];
+    int induction_count;
+    int counter;   // induction compared by the `cmp`
+    Operand bound; // what the counter is compared against
+    OpType exit;   // `OP_JUMPL` or `OP_JUMPG`
+    int dst;       // induction holding the address written by fill and copy
+    int src;       // induction holding the address read by copy and sum
+    Operand value; // stored by fill
+    int acc;       // register that sum adds into
+} Loop;
+
+typedef struct {
+    Loop *data;
+    size_t size;
+    size_t capacity;
+    // index plus one of the loop closed by the jump at each opcode, 0 for
+    // every other opcode, NULL when there are no loops
+    size_t *closed_by;
+    size_t opcodes; // length of `closed_by`
+} Loops;
+
+// Finds the loops that can be run natively. The opcodes are left as they are
+// since they can be shared with the module they were compiled from.
+void find_loops(OpCodes opcodes, Loops *loops);
+void loops_free(Loops *loops);
+void display_loops(Loops loops, OpCodes opcodes);
+
+#endif
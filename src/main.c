@@ -1,78 +1,309 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "interpreter.h"
+#include "linker.h"
+#include "loops.h"
+#include "options.h"
 #include "parser.h"
+#include "scheduler.h"
+#include "server.h"
+#include "stats.h"
 #include "utils.h"
+#include "watch.h"
 
-bool parse_and_interpret(const char *source_file, bool debug) {
-    StringView sv;
-    if (!read_to_string(source_file, &sv)) {
-        return false;
+bool parse_and_interpret(const char *source_file, Options *options,
+                         ModuleCache *modules) {
+    Stats parse_stats;
+    if (options->stats) {
+        stats_start(&parse_stats, "parsing");
     }
-
-    Parser p;
-    parser_init(&p, sv);
-    OpCodes opcodes = {0};
-    Labels labels = {0};
-    if (!parse(&p, &opcodes, &labels)) {
+    Module *module = module_load(modules, source_file);
+    Program program;
+    if (!module || !link_program(modules, module, &program)) {
+        if (options->stats) {
+            stats_cancel(&parse_stats);
+        }
         return false;
     }
-    if (!patch_labels(&opcodes, labels)) {
-        return false;
+    if (options->stats) {
+        stats_stop(&parse_stats);
     }
+    OpCodes opcodes = program.opcodes;
 
-    if (debug) {
+    if (options->debug) {
         printf("Opcodes:\n");
         display_opcodes(opcodes);
         printf("\nLabels:\n");
-        display_labels(labels);
+        display_labels(program.labels);
+        if (program.data.size) {
+            printf("\nData:\n");
+            display_data(program.data);
+        }
+        if (program.loops.size) {
+            printf("\nLoops:\n");
+            display_loops(program.loops, opcodes);
+        }
+    }
+
+    if (options->green) {
+        if (options->stats) {
+            stats_report(&parse_stats, 0);
+        }
+        bool ok = run_green(opcodes, program.data, &program.loops, options);
+        program_free(&program);
+        return ok;
     }
 
     State state;
     if (!state_init(&state)) {
         printf("bass: failed to allocate enough memory, exiting\n");
+        program_free(&program);
         return false;
     }
-    if (!interpret(&state, opcodes)) {
+    state.wide = options->wide;
+    state.loops = &program.loops;
+    // file mappings are placed over the data segments
+    state_load_image(&state, program.data);
+    for (size_t i = 0; i < options->mappings.size; i++) {
+        if (!state_map_file(&state, options->mappings.data[i])) {
+            state_free(&state);
+            program_free(&program);
+            return false;
+        }
+    }
+    if (options->memtrace) {
+        state.trace = memtrace_new(opcodes.size);
+        if (!state.trace) {
+            fprintf(stderr, "bass: failed to allocate memory trace\n");
+        }
+    }
+    Stats interpret_stats;
+    if (options->stats) {
+        stats_start(&interpret_stats, "interpreting");
+    }
+    bool ok = interpret(&state, opcodes);
+    if (options->stats) {
+        stats_stop(&interpret_stats);
+        fflush(stdout);
+        stats_report(&parse_stats, 0);
+        stats_report(&interpret_stats, state.retired);
+    }
+    if (state.trace) {
+        fflush(stdout);
+        memtrace_report(state.trace, opcodes);
+        memtrace_free(state.trace);
+    }
+    state_free(&state);
+    program_free(&program);
+    return ok;
+}
+
+// parses `FILE@ADDR[:ro|rw]`, mappings are read-only by default
+bool parse_map_option(const char *spec, Mapping *mapping) {
+    const char *at = strrchr(spec, '@');
+    if (!at || at == spec) {
+        fprintf(stderr, "bass: invalid mapping `%s`\n"
+                        "help: expected FILE@ADDR[:ro|rw]\n", spec);
         return false;
     }
+    char *end;
+    errno = 0;
+    unsigned long addr = strtoul(at + 1, &end, 0);
+    if (end == at + 1 || errno != 0) {
+        fprintf(stderr, "bass: invalid mapping address in `%s`\n", spec);
+        return false;
+    }
+    bool writable = false;
+    if (strcmp(end, ":rw") == 0) {
+        writable = true;
+    } else if (*end != '\0' && strcmp(end, ":ro") != 0) {
+        fprintf(stderr, "bass: invalid mapping mode `%s` in `%s`\n"
+                        "help: mode can be either `ro` or `rw`\n", end, spec);
+        return false;
+    }
+    StringView path = {spec, at - spec};
+    *mapping = (Mapping){string_view_to_cstring(path), addr, 0, writable};
     return true;
 }
 
 void print_help() {
-    fprintf(stderr, "usage: bass [--help|-h] [--debug|-d] [FILES ...]\n\n"
+    fprintf(stderr, "usage: bass [--help|-h] [--debug|-d] [--stats|-s] "
+                    "[--wide|-w] [--memtrace]\n"
+                    "            [--jobs|-j N] [--map FILE@ADDR[:ro|rw]]\n"
+                    "            [--green N [--quantum N]] [FILES ...]\n"
+                    "       bass [OPTIONS] --watch FILE\n"
+                    "       bass [OPTIONS] --serve SOCKET [--pool N] "
+                    "[--timeout MS] [--root DIR]\n"
+                    "       bass --client SOCKET [--reg N=VALUE ...] "
+                    "[--bench RUNS] FILE|-\n\n"
                     "a simple interpreted language that mimics the look and "
                     "feel of assembly\n\n"
                     "options:\n"
                     "  -h, --help  show this help message and exit\n"
-                    "  -d, --debug show some debug info before running file\n");
+                    "  -d, --debug show some debug info before running file\n"
+                    "  -s, --stats report timings and hardware performance "
+                    "counters\n"
+                    "              for parsing and interpreting\n"
+                    "  -w, --wide  use 64-bit registers instead of wrapping "
+                    "values at 32 bits\n"
+                    "  --memtrace  report memory access heatmap and strides "
+                    "after running\n"
+                    "  -j, --jobs  number of threads used to parse large "
+                    "files and run green\n"
+                    "              threads (default: all cpus)\n"
+                    "  -m, --map   map FILE into memory at ADDR for the files "
+                    "that follow\n"
+                    "              (read-only by default, `rw` writes back "
+                    "to FILE)\n"
+                    "  --green     run N copies of each file as green threads, "
+                    "every copy\n"
+                    "              starts with its index in r0\n"
+                    "  --quantum   opcodes a green thread runs before it is "
+                    "preempted\n"
+                    "              (default: %d)\n"
+                    "  --watch     run FILE and swap every edit of it into the "
+                    "running program\n"
+                    "  --serve     run programs sent to SOCKET on a pool of "
+                    "warm VMs\n"
+                    "  --pool      number of worker processes used by "
+                    "`--serve` (default: all cpus)\n"
+                    "  --timeout   milliseconds after which `--serve` stops a "
+                    "program\n"
+                    "              (default: %d)\n"
+                    "  --root      directory that programs run by `--serve` "
+                    "can read files in\n"
+                    "              (default: the current directory)\n"
+                    "  --client    run FILE (or the source read from stdin) "
+                    "through SOCKET\n"
+                    "              `--reg` sets initial registers and `--bench` "
+                    "compares the\n"
+                    "              latency against starting a new `bass`\n",
+            GREEN_QUANTUM, SERVER_TIMEOUT);
 }
 
-int main(int argc, char *argv[]) {
-    bool debug = false;
+// handles the arguments in order, running every file as it comes up
+static int run(int argc, char *argv[], Options *options,
+               ModuleCache *modules) {
     int files_count = 0;
+    const char *socket_path = NULL;
 
     for (int i = 1; i < argc; i++) {
         if ((strcmp(argv[i], "--debug") == 0) || (strcmp(argv[i], "-d") == 0)) {
-            if (!debug) {
+            if (!options->debug) {
                 printf("bass: enabling debug mode\n");
             }
-            debug = true;
+            options->debug = true;
+        } else if ((strcmp(argv[i], "--stats") == 0) ||
+                   (strcmp(argv[i], "-s") == 0)) {
+            options->stats = true;
+        } else if ((strcmp(argv[i], "--wide") == 0) ||
+                   (strcmp(argv[i], "-w") == 0)) {
+            options->wide = true;
+        } else if (strcmp(argv[i], "--memtrace") == 0) {
+            options->memtrace = true;
         } else if ((strcmp(argv[i], "--help") == 0) ||
                    (strcmp(argv[i], "-h") == 0)) {
             print_help();
             return 0;
+        } else if ((strcmp(argv[i], "--jobs") == 0) ||
+                   (strcmp(argv[i], "-j") == 0)) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "bass: expected thread count after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pool") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "bass: expected worker count after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->pool = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--green") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "bass: expected number of copies after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->green = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quantum") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "bass: expected opcode count after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->quantum = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "bass: expected milliseconds after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--root") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "bass: expected directory after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            options->root = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "bass: expected socket path after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            // options following `--serve` still apply to the server
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            if (i + 2 != argc) {
+                fprintf(stderr, "bass: expected a single file after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            return watch(argv[i + 1], options) ? 0 : 1;
+        } else if (strcmp(argv[i], "--client") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "bass: expected socket path after `%s`\n",
+                        argv[i]);
+                return 1;
+            }
+            return run_client(argv[i + 1], argc - i - 2, &argv[i + 2]);
+        } else if ((strcmp(argv[i], "--map") == 0) ||
+                   (strcmp(argv[i], "-m") == 0)) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "bass: expected mapping after `%s`\n", argv[i]);
+                return 1;
+            }
+            Mapping mapping;
+            if (!parse_map_option(argv[++i], &mapping)) {
+                return 1;
+            }
+            dyn_append(&options->mappings, mapping);
+        } else if (socket_path) {
+            fprintf(stderr, "bass: unexpected argument `%s`\n", argv[i]);
+            return 1;
         } else {
             files_count++;
-            if (!parse_and_interpret(argv[i], debug)) {
+            modules->jobs = options->jobs;
+            if (!parse_and_interpret(argv[i], options, modules)) {
                 fprintf(stderr, "bass: failed to run `%s`\n", argv[i]);
                 return 1;
             }
         }
     }
 
+    if (socket_path && files_count > 0) {
+        fprintf(stderr, "bass: files cant be run along with `--serve`\n");
+        return 1;
+    }
+    if (socket_path) {
+        return serve(socket_path, options) ? 0 : 1;
+    }
     if (files_count == 0) {
         fprintf(stderr, "bass: no input files provided\n");
         return 1;
@@ -80,3 +311,21 @@ int main(int argc, char *argv[]) {
 
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    Options options = {0};
+    options.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    options.pool = options.jobs;
+    options.quantum = GREEN_QUANTUM;
+    options.timeout = SERVER_TIMEOUT;
+    // modules imported by several files are only compiled once
+    ModuleCache modules = {0};
+
+    int status = run(argc, argv, &options, &modules);
+    module_cache_free(&modules);
+    for (size_t i = 0; i < options.mappings.size; i++) {
+        free((char *)options.mappings.data[i].path);
+    }
+    free(options.mappings.data);
+    return status;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memtrace.h"
+#include "parser.h"
+
+MemTrace *memtrace_new(size_t op_count) {
+    MemTrace *trace = calloc(1, sizeof(MemTrace));
+    if (!trace) {
+        return NULL;
+    }
+    trace->ops = calloc(op_count ? op_count : 1, sizeof(OpTrace));
+    if (!trace->ops) {
+        free(trace);
+        return NULL;
+    }
+    trace->op_count = op_count;
+    return trace;
+}
+
+void memtrace_free(MemTrace *trace) {
+    if (trace) {
+        free(trace->ops);
+        free(trace);
+    }
+}
+
+static inline StrideBucket stride_bucket(size_t stride) {
+    if (stride == 0) return STRIDE_0;
+    if (stride < 4) return STRIDE_SUBWORD;
+    if (stride == 4) return STRIDE_WORD;
+    if (stride < MEMTRACE_LINE_SIZE) return STRIDE_LINE;
+    if (stride < MEMTRACE_PAGE_SIZE) return STRIDE_PAGE;
+    return STRIDE_FAR;
+}
+
+void memtrace_record(MemTrace *trace, size_t op, size_t address, int width,
+                     bool write) {
+    if (write) {
+        trace->writes++;
+    } else {
+        trace->reads++;
+    }
+    bool misaligned = address % width != 0;
+    trace->misaligned += misaligned;
+
+    if (op < trace->op_count) {
+        OpTrace *op_trace = &trace->ops[op];
+        if (op_trace->accesses > 0) {
+            size_t last = op_trace->last_address;
+            if (address >= last) {
+                op_trace->strides[0][stride_bucket(address - last)]++;
+            } else {
+                op_trace->strides[1][stride_bucket(last - address)]++;
+            }
+        }
+        op_trace->accesses++;
+        op_trace->misaligned += misaligned;
+        op_trace->last_address = address;
+    }
+
+    if (address >= MEMORY_SIZE) {
+        trace->out_of_bounds++;
+        return;
+    }
+    AccessCount *line = &trace->lines[address / MEMTRACE_LINE_SIZE];
+    AccessCount *page = &trace->pages[address / MEMTRACE_PAGE_SIZE];
+    if (write) {
+        line->writes++;
+        page->writes++;
+    } else {
+        line->reads++;
+        page->reads++;
+    }
+}
+
+typedef struct {
+    size_t index;
+    uint64_t total;
+} HotLine;
+
+static int compare_hot_lines(const void *a, const void *b) {
+    uint64_t x = ((const HotLine *)a)->total, y = ((const HotLine *)b)->total;
+    return (x < y) - (x > y);
+}
+
+static void report_hot_lines(MemTrace *trace) {
+    size_t line_count = MEMORY_SIZE / MEMTRACE_LINE_SIZE;
+    HotLine *touched = malloc(line_count * sizeof(HotLine));
+    if (!touched) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < line_count; i++) {
+        uint64_t total = trace->lines[i].reads + trace->lines[i].writes;
+        if (total) {
+            touched[count++] = (HotLine){i, total};
+        }
+    }
+    qsort(touched, count, sizeof(HotLine), compare_hot_lines);
+
+    size_t pages = 0;
+    for (size_t i = 0; i < MEMORY_SIZE / MEMTRACE_PAGE_SIZE; i++) {
+        pages += trace->pages[i].reads || trace->pages[i].writes;
+    }
+    fprintf(stderr, "  touched %zu cache lines (%zu bytes) in %zu pages\n",
+            count, count * MEMTRACE_LINE_SIZE, pages);
+
+    if (count > 0) {
+        fprintf(stderr, "  hottest cache lines:\n");
+    }
+    for (size_t i = 0; i < count && i < MEMTRACE_TOP_LINES; i++) {
+        AccessCount line = trace->lines[touched[i].index];
+        fprintf(stderr, "    @%-8zu reads %-10llu writes %llu\n",
+                touched[i].index * MEMTRACE_LINE_SIZE,
+                (unsigned long long)line.reads,
+                (unsigned long long)line.writes);
+    }
+    free(touched);
+}
+
+static int bit_length(uint64_t value) {
+    int bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// one character per page from the first to the last touched page, with the
+// intensity on a log scale relative to the hottest page
+static void report_heatmap(MemTrace *trace) {
+    static const char shades[] = " .:-=+*#%@";
+    size_t page_count = MEMORY_SIZE / MEMTRACE_PAGE_SIZE;
+    size_t first = page_count, last = 0;
+    uint64_t hottest = 0;
+    for (size_t i = 0; i < page_count; i++) {
+        uint64_t total = trace->pages[i].reads + trace->pages[i].writes;
+        if (total) {
+            if (first == page_count) first = i;
+            last = i;
+            if (total > hottest) hottest = total;
+        }
+    }
+    if (hottest == 0) {
+        return;
+    }
+
+    fprintf(stderr, "  page heatmap (%d bytes per column, `%c` is hottest):\n",
+            MEMTRACE_PAGE_SIZE, shades[sizeof(shades) - 2]);
+    const size_t width = 64;
+    const int levels = sizeof(shades) - 3; // shades besides ` ` and `.`
+    for (size_t row = first / width * width; row <= last; row += width) {
+        fprintf(stderr, "    @%-8zu |", row * MEMTRACE_PAGE_SIZE);
+        for (size_t i = row; i < row + width && i < page_count; i++) {
+            uint64_t total = trace->pages[i].reads + trace->pages[i].writes;
+            int shade = 0;
+            if (total) {
+                shade = 1 + bit_length(total) * levels / bit_length(hottest);
+            }
+            fputc(shades[shade], stderr);
+        }
+        fprintf(stderr, "|\n");
+    }
+}
+
+static void report_strides(MemTrace *trace, OpCodes opcodes) {
+    fprintf(stderr, "  accesses per opcode (stride histogram, - for "
+                    "backwards):\n");
+    for (size_t i = 0; i < trace->op_count && i < opcodes.size; i++) {
+        OpTrace *op = &trace->ops[i];
+        if (op->accesses == 0) {
+            continue;
+        }
+        OpCode opcode = opcodes.data[i];
+        fprintf(stderr, "    %d:%zu %-7s accesses %llu, misaligned %llu",
+                opcode.line, opcode.col, OPCODES[opcode.op].name,
+                (unsigned long long)op->accesses,
+                (unsigned long long)op->misaligned);
+        uint64_t total = op->accesses > 1 ? op->accesses - 1 : 0;
+        if (total) {
+            fprintf(stderr, ", strides");
+        }
+        for (int dir = 0; dir < 2; dir++) {
+            for (int b = 0; b < STRIDE_COUNT; b++) {
+                if (op->strides[dir][b] == 0 || (dir == 1 && b == STRIDE_0)) {
+                    continue;
+                }
+                fprintf(stderr, " %s%s:%.0f%%", dir ? "-" : "",
+                        STRIDE_STRING[b], 100.0 * op->strides[dir][b] / total);
+            }
+        }
+        fputc('\n', stderr);
+    }
+}
+
+void memtrace_report(MemTrace *trace, OpCodes opcodes) {
+    fprintf(stderr, "bass: memory trace:\n");
+    fprintf(stderr, "  reads %llu, writes %llu, misaligned %llu",
+            (unsigned long long)trace->reads,
+            (unsigned long long)trace->writes,
+            (unsigned long long)trace->misaligned);
+    if (trace->out_of_bounds) {
+        fprintf(stderr, ", out of bounds %llu",
+                (unsigned long long)trace->out_of_bounds);
+    }
+    fputc('\n', stderr);
+    report_hot_lines(trace);
+    report_heatmap(trace);
+    report_strides(trace, opcodes);
+}
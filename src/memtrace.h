@@ -0,0 +1,66 @@
+#ifndef BASS_MEMTRACE_H
+#define BASS_MEMTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "parser.h"
+
+#define MEMTRACE_LINE_SIZE 64
+#define MEMTRACE_PAGE_SIZE 4096
+#define MEMTRACE_TOP_LINES 10
+
+typedef enum {
+    STRIDE_0,
+    STRIDE_SUBWORD,   // 1-3 bytes
+    STRIDE_WORD,      // 4 bytes
+    STRIDE_LINE,      // 5-63 bytes, likely within the same cache line
+    STRIDE_PAGE,      // 64-4095 bytes, likely within the same page
+    STRIDE_FAR,       // 4096 bytes and more
+
+    STRIDE_COUNT
+} StrideBucket;
+
+static const char *const STRIDE_STRING[STRIDE_COUNT] = {
+    [STRIDE_0] = "0",
+    [STRIDE_SUBWORD] = "1-3",
+    [STRIDE_WORD] = "4",
+    [STRIDE_LINE] = "5-63",
+    [STRIDE_PAGE] = "64-4095",
+    [STRIDE_FAR] = "4096+",
+};
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+} AccessCount;
+
+// accesses made by a single opcode
+typedef struct {
+    uint64_t accesses;
+    uint64_t misaligned;
+    size_t last_address; // previous address, used for the stride
+    // strides between consecutive accesses, [0] forwards and [1] backwards
+    uint64_t strides[2][STRIDE_COUNT];
+} OpTrace;
+
+typedef struct {
+    AccessCount lines[MEMORY_SIZE / MEMTRACE_LINE_SIZE];
+    AccessCount pages[MEMORY_SIZE / MEMTRACE_PAGE_SIZE];
+    OpTrace *ops; // indexed by opcode
+    size_t op_count;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t misaligned;
+    uint64_t out_of_bounds;
+} MemTrace;
+
+// returns NULL when the allocation fails
+MemTrace *memtrace_new(size_t op_count);
+void memtrace_free(MemTrace *trace);
+void memtrace_record(MemTrace *trace, size_t op, size_t address, int width,
+                     bool write);
+void memtrace_report(MemTrace *trace, OpCodes opcodes);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef BASS_OPTIONS_H
+#define BASS_OPTIONS_H
+
+#include <stdbool.h>
+
+#include "interpreter.h"
+
+// command line options that apply to the files (or server) following them
+typedef struct {
+    bool debug;
+    bool stats; // report performance counters for parsing and interpreting
+    bool wide;  // 64-bit registers
+    bool memtrace; // report memory access patterns after running
+    int jobs;   // threads used for parsing
+    int pool;   // worker processes (each with a warm VM) used by `--serve`
+    int green;  // copies of each program run as green threads, 0 to disable
+    int quantum; // opcodes that a green thread runs before it is preempted
+    int timeout; // milliseconds that a request to `--serve` can take
+    const char *root; // directory that programs run by `--serve` can read
+    Mappings mappings;
+} Options;
+
+#endif
@@ -1,5 +1,7 @@
-#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -7,6 +9,46 @@
 #include "parser.h"
 #include "utils.h"
 
+#define CC_ALPHA 1
+#define CC_DIGIT 2
+#define CC_SPACE 4
+#define CC_UNDERSCORE 8
+
+// character classes for the C locale, used instead of the <ctype.h>
+// functions which are locale aware calls
+static const unsigned char CHAR_CLASS[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 8,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#define char_is(c, class) (CHAR_CLASS[(unsigned char)(c)] & (class))
+#define is_alpha(c) char_is(c, CC_ALPHA)
+#define is_digit(c) char_is(c, CC_DIGIT)
+#define is_space(c) char_is(c, CC_SPACE)
+#define is_alnum(c) char_is(c, CC_ALPHA | CC_DIGIT)
+#define is_ident(c) char_is(c, CC_ALPHA | CC_DIGIT | CC_UNDERSCORE)
+
+#define parser_error(parser, ...)                                              \
+    do {                                                                       \
+        if (!(parser)->quiet) {                                                \
+            fprintf(stderr, __VA_ARGS__);                                      \
+        }                                                                      \
+    } while (0)
+
 static inline char next(Parser *parser) {
     if (parser->end < parser->source.length) {
         char next = parser->source.data[parser->end];
@@ -30,9 +72,30 @@ static inline const char *peek_ref(Parser *parser) {
     return NULL;
 }
 
+// skips to the end of the line (leaving the newline to be consumed)
+static inline void skip_comment(Parser *parser) {
+    const char *cur = &parser->source.data[parser->end];
+    const char *newline =
+        memchr(cur, '\n', parser->source.length - parser->end);
+    parser->end = newline ? (size_t)(newline - parser->source.data)
+                          : parser->source.length;
+}
+
+static inline void skip_blanks(Parser *parser) {
+    const char *data = parser->source.data;
+    size_t end = parser->end;
+    while (end < parser->source.length && data[end] != '\n' &&
+           is_space(data[end])) {
+        end++;
+    }
+    parser->end = end;
+    parser->start = end;
+}
+
 bool get_opcode(StringView string, OpType *type) {
     for (size_t i = 0; i < OP_COUNT; i++) {
-        if (string_view_cstring_eq(string, OPCODES[i].name)) {
+        if (OPCODES[i].name[0] == string.data[0] &&
+            string_view_cstring_eq(string, OPCODES[i].name)) {
             *type = i;
             return true;
         }
@@ -40,58 +103,134 @@ bool get_opcode(StringView string, OpType *type) {
     return false;
 }
 
+// Converts the number in [digits, end), returns false if it wasnt entirely a
+// number or doesnt fit into a long. Plain decimal numbers are converted
+// inline, anything with a base prefix (or a leading 0 for octal) is left to
+// strtol.
+static bool convert_num(const char *digits, const char *end, long *num) {
+    bool negative = digits[0] == '-';
+    const char *cur = digits + negative;
+    if (cur < end && end - cur <= 18 &&
+        (cur[0] != '0' || end - cur == 1)) {
+        long value = 0;
+        while (cur < end && is_digit(*cur)) {
+            value = value * 10 + (*cur - '0');
+            cur++;
+        }
+        if (cur == end) {
+            *num = negative ? -value : value;
+            return true;
+        }
+    }
+    char *parsed;
+    errno = 0;
+    *num = strtol(digits, &parsed, 0);
+    return parsed == end && errno != ERANGE;
+}
+
 bool parse_num(Parser *parser, long *num, StringView *string) {
     int skip = parser->end - parser->start;
 
     // allow negative integers
     if (peek(parser) == '-') {
         next(parser);
-    } else if (!isdigit(peek(parser))) {
-        fprintf(stderr, "bass: unexpected character: `%c` at: %d:%zu\n",
-                peek(parser), parser->line, get_col(parser));
+    } else if (!is_digit(peek(parser))) {
+        parser_error(parser, "bass: unexpected character: `%c` at: %d:%zu\n",
+                     peek(parser), parser->line, get_col(parser));
         return false;
     }
 
-    while (isalnum(peek(parser))) {
+    while (is_alnum(peek(parser))) {
         next(parser);
     }
 
-    if (!(isspace(peek(parser)) || peek(parser) == '\0')) {
-        fprintf(stderr, "bass: unexpected character `%c` at: %d:%zu\n",
-                peek(parser), parser->line, get_col(parser));
+    if (!(is_space(peek(parser)) || peek(parser) == '\0')) {
+        parser_error(parser, "bass: unexpected character `%c` at: %d:%zu\n",
+                     peek(parser), parser->line, get_col(parser));
         return false;
     }
 
     *string = get_string(parser);
     if (string->length <= 1) {
-        fprintf(stderr, "bass: expected number at: %d:%zu\n", parser->line,
-                parser->start);
+        parser_error(parser, "bass: expected number at: %d:%zu\n", parser->line,
+                     parser->start);
         return false;
     }
 
-    // TODO: strtol: check for errors
-    *num = strtol(&parser->source.data[parser->start + skip], NULL, 0);
+    const char *digits = &parser->source.data[parser->start + skip];
+    const char *end = &parser->source.data[parser->end];
+    if (!convert_num(digits, end, num)) {
+        parser_error(parser,
+                     "bass: invalid number `%.*s` at: %d:%zu\n"
+                     "help: numbers are decimal, hexadecimal (`0x`) or octal "
+                     "(`0`) and have to fit into 64 bits\n",
+                     (int)(end - digits), digits, parser->line,
+                     (size_t)(digits - parser->source.data) -
+                         parser->line_start + 1);
+        return false;
+    }
     return true;
 }
 
 // TODO: Reset the parser->start
 static inline StringView parse_identifier(Parser *parser) {
-    while (isalnum(peek(parser)) || peek(parser) == '_') {
+    while (is_ident(peek(parser))) {
         next(parser);
     }
     return get_string(parser);
 }
 
+static bool find_constant(Parser *parser, StringView name, int64_t *value) {
+    for (size_t i = 0; i < parser->constants.size; i++) {
+        if (string_view_eq(parser->constants.data[i].name, name)) {
+            *value = parser->constants.data[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// defines a constant that was parsed separately, returns false if it is
+// already defined (which `parse` reports as an error)
+static bool merge_constant(Parser *parser, Constant constant) {
+    int64_t existing;
+    if (find_constant(parser, constant.name, &existing)) {
+        return false;
+    }
+    arena_dyn_append(&parser->arena, &parser->constants, constant);
+    return true;
+}
+
+// parses the name of a constant used as an operand
+static bool parse_constant(Parser *parser, int64_t *value, StringView *name) {
+    parser->start = parser->end;
+    *name = parse_identifier(parser);
+    if (!find_constant(parser, *name, value)) {
+        parser_error(parser, "bass: undefined constant `%.*s` at: %d:%zu\n"
+                             "help: constants are defined with `.equ NAME "
+                             "VALUE` before being used\n",
+                     SV_FORMAT(*name), parser->line,
+                     parser->start - parser->line_start + 1);
+        return false;
+    }
+    return true;
+}
+
 // parses character or string literals delimited by `quote`
 bool parse_quoted_char(Parser *parser, StringView *string, char quote,
                        const char *type) {
     parser->start = parser->end;
+    // string literals can span multiple lines
     while (peek(parser) != quote && peek(parser) != '\0') {
-        next(parser);
+        if (next(parser) == '\n') {
+            parser->line_start = parser->end;
+            parser->line++;
+            parser->multiline = true;
+        }
     }
     if (peek(parser) != quote) {
-        fprintf(stderr, "bass: unterminated %s literal at: %d:%zu\n", type,
-                parser->line, parser->start);
+        parser_error(parser, "bass: unterminated %s literal at: %d:%zu\n", type,
+                     parser->line, parser->start);
         return false;
     }
     *string = get_string(parser);
@@ -105,20 +244,19 @@ bool parse_register(Parser *parser, long *num, StringView *string) {
         return false;
     }
     if (*num < 0 || REG_COUNT <= *num) {
-        fprintf(stderr,
-                "bass: invalid register `%ld` at: %d:%zu\n"
-                "help: registers can range from 0 to %d\n",
-                *num, parser->line, get_col(parser), REG_COUNT - 1);
+        parser_error(parser,
+                     "bass: invalid register `%ld` at: %d:%zu\n"
+                     "help: registers can range from 0 to %d\n",
+                     *num, parser->line, get_col(parser), REG_COUNT - 1);
         return false;
     }
     return true;
 }
 
-// TODO: the function assignes a value of long to an int (num is long, Operand
-// has int member variable)
 bool parse_operands(Parser *parser, OpType op, Operand operands[MAX_OPERANDS]) {
     int i = 0;
     while (i < OPCODES[op].arity) {
+        skip_blanks(parser);
         char current = next(parser);
         long num;
         StringView string;
@@ -127,40 +265,58 @@ bool parse_operands(Parser *parser, OpType op, Operand operands[MAX_OPERANDS]) {
             if (!parse_register(parser, &num, &string)) {
                 return false;
             }
-            operands[i++] = (Operand){TOK_REGISTER, string, num};
+            operands[i++] = (Operand){TOK_REGISTER, num, string};
         } break;
         case '#': {
+            int64_t value;
+            if (is_alpha(peek(parser))) {
+                if (!parse_constant(parser, &value, &string)) {
+                    return false;
+                }
+                operands[i++] = (Operand){TOK_LITERAL_NUM, value, string};
+                break;
+            }
             if (!parse_num(parser, &num, &string)) {
                 return false;
             }
-            operands[i++] = (Operand){TOK_LITERAL_NUM, string, num};
+            operands[i++] = (Operand){TOK_LITERAL_NUM, num, string};
         } break;
         case '@': {
+            int64_t value;
             // parsing as memory address
-            if (isdigit(peek(parser))) {
+            if (is_digit(peek(parser))) {
                 if (!parse_num(parser, &num, &string)) {
                     return false;
                 }
-                operands[i++] = (Operand){TOK_ADDRESS, string, num};
+                operands[i++] = (Operand){TOK_ADDRESS, num, string};
 
                 // parsing as address at register
-            } else if (peek(parser) == 'r') {
+            } else if (peek(parser) == 'r' &&
+                       parser->end + 1 < parser->source.length &&
+                       is_digit(parser->source.data[parser->end + 1])) {
                 next(parser);
                 if (!parse_register(parser, &num, &string)) {
                     return false;
                 }
-                operands[i++] = (Operand){TOK_ADDRESS_REG, string, num};
+                operands[i++] = (Operand){TOK_ADDRESS_REG, num, string};
+
+                // parsing as address in a constant
+            } else if (is_alpha(peek(parser))) {
+                if (!parse_constant(parser, &value, &string)) {
+                    return false;
+                }
+                operands[i++] = (Operand){TOK_ADDRESS, value, string};
             } else {
                 if (peek(parser) == '\n') {
-                    fprintf(
-                        stderr,
+                    parser_error(
+                        parser,
                         "bass: expected register or value after `@` got `\\n` "
                         "at: %d:%zu\n",
                         parser->line, get_col(parser) + 2);
 
                 } else {
-                    fprintf(
-                        stderr,
+                    parser_error(
+                        parser,
                         "bass: expected register or value after `@` got `%c` "
                         "at: %d:%zu\n",
                         peek(parser), parser->line, get_col(parser) + 2);
@@ -174,31 +330,31 @@ bool parse_operands(Parser *parser, OpType op, Operand operands[MAX_OPERANDS]) {
         } break;
 
         default: {
-            if (!isspace(current)) {
+            if (!is_space(current)) {
                 if (current == '\0') {
-                    fprintf(
-                        stderr,
+                    parser_error(
+                        parser,
                         "bass: expected register, value or memory address but "
                         "got EOF after: %d:%zu\n",
                         parser->line, get_col(parser));
                 } else {
-                    fprintf(
-                        stderr,
+                    parser_error(
+                        parser,
                         "bass: expected register, value or memory address but "
                         "got `%c` at: %d:%zu\n",
                         current, parser->line, get_col(parser));
                 }
-                if (isdigit(current)) {
-                    fprintf(
-                        stderr,
+                if (is_digit(current)) {
+                    parser_error(
+                        parser,
                         "help: try prefixing `%c` with `r` for register, `#` "
                         "for a literal value or `@` for a memory address\n",
                         current);
                 } else {
-                    fprintf(stderr,
-                            "help: opcode `%s` takes %d arguments but got "
-                            "%d instead\n",
-                            OPCODES[op].name, OPCODES[op].arity, i);
+                    parser_error(parser,
+                                 "help: opcode `%s` takes %d arguments but got "
+                                 "%d instead\n",
+                                 OPCODES[op].name, OPCODES[op].arity, i);
                 }
                 return false;
             }
@@ -210,10 +366,10 @@ bool parse_operands(Parser *parser, OpType op, Operand operands[MAX_OPERANDS]) {
 }
 
 bool parse_jump(Parser *parser, Operand *operand) {
-    if (isalpha(next(parser))) {
+    if (is_alpha(next(parser))) {
         StringView string = parse_identifier(parser);
         parser->start = parser->end;
-        *operand = (Operand){TOK_LABEL, string, -1};
+        *operand = (Operand){TOK_LABEL, -1, string};
         return true;
     }
     return false;
@@ -230,25 +386,25 @@ bool parse_print(Parser *parser, Operand *operand) {
             return false;
         }
         if (string.length == 0) {
-            fprintf(stderr, "bass: empty character literal at %zu\n",
-                    parser->end);
+            parser_error(parser, "bass: empty character literal at %zu\n",
+                         parser->end);
             return false;
         }
 
         // newline escape character
         if (string.data[0] == '\\' && string.length == 2 &&
             string.data[1] == 'n') {
-            *operand = (Operand){TOK_LITERAL_CHAR, string, '\n'};
+            *operand = (Operand){TOK_LITERAL_CHAR, '\n', string};
             return true;
         }
 
         if (string.length > 1) {
-            fprintf(stderr,
-                    "bass: character literal: `%.*s` is too long at %zu\n",
-                    SV_FORMAT(string), parser->end);
+            parser_error(parser,
+                         "bass: character literal: `%.*s` is too long at %zu\n",
+                         SV_FORMAT(string), parser->end);
             return false;
         }
-        *operand = (Operand){TOK_LITERAL_CHAR, string, string.data[0]};
+        *operand = (Operand){TOK_LITERAL_CHAR, string.data[0], string};
         return true;
     }
     case '\"': {
@@ -257,7 +413,7 @@ bool parse_print(Parser *parser, Operand *operand) {
         if (!parse_quoted_char(parser, &string, '\"', "string")) {
             return false;
         }
-        *operand = (Operand){TOK_LITERAL_STR, string, 0};
+        *operand = (Operand){TOK_LITERAL_STR, 0, string};
         return true;
     }
     default:
@@ -269,12 +425,21 @@ bool parse_opcode(Parser *parser, StringView string, OpCode *opcode) {
     OpType op_type;
     size_t col = parser->start - parser->line_start + 1;
     if (!get_opcode(string, &op_type)) {
-        fprintf(stderr, "bass: invalid opcode `%.*s` at: %d:%zu\n",
-                SV_FORMAT(string), parser->line, col);
+        parser_error(parser, "bass: invalid opcode `%.*s` at: %d:%zu\n",
+                     SV_FORMAT(string), parser->line, col);
         return false;
     }
+    int line = parser->line;
+    // the separator after the opcode that was consumed by `parse` can be a
+    // newline as well
+    if (parser->source.data[parser->end - 1] == '\n') {
+        parser->line_start = parser->end;
+        parser->line++;
+        parser->multiline |= OPCODES[op_type].arity > 0;
+    }
     parser->start = parser->end;
-    Operand operands[MAX_OPERANDS] = {0};
+    Operand *operands = opcode->operands;
+    memset(operands, 0, sizeof(Operand) * MAX_OPERANDS);
     if (op_type == OP_JUMP || op_type == OP_JUMPZ || op_type == OP_JUMPG ||
         op_type == OP_JUMPL) {
         if (!parse_jump(parser, &operands[0])) {
@@ -290,48 +455,402 @@ bool parse_opcode(Parser *parser, StringView string, OpCode *opcode) {
         }
     }
     opcode->op = op_type;
-    opcode->line = parser->line;
+    opcode->line = line;
     opcode->col = col;
-    memcpy(&opcode->operands, operands, sizeof(Operand) * MAX_OPERANDS);
+    return true;
+}
+
+// counts occurences of `c` in the source, used to size the parse output
+static size_t count_char(StringView source, char c) {
+    size_t count = 0;
+    const char *cur = source.data;
+    const char *end = source.data + source.length;
+    while ((cur = memchr(cur, c, end - cur))) {
+        count++;
+        cur++;
+    }
+    return count;
+}
+
+// skips blanks and the commas separating the arguments of a directive
+static inline void skip_separators(Parser *parser) {
+    skip_blanks(parser);
+    while (peek(parser) == ',') {
+        next(parser);
+        skip_blanks(parser);
+    }
+}
+
+static inline bool at_line_end(Parser *parser) {
+    char c = peek(parser);
+    return c == '\n' || c == '\0' || c == ';';
+}
+
+// parses a number or the name of a constant as the argument of a directive
+static bool parse_value(Parser *parser, int64_t *value) {
+    skip_separators(parser);
+    parser->start = parser->end;
+    char c = peek(parser);
+    if (is_alpha(c)) {
+        StringView name;
+        return parse_constant(parser, value, &name);
+    }
+    if (c == '-' || is_digit(c)) {
+        next(parser);
+        while (is_alnum(peek(parser))) {
+            next(parser);
+        }
+        StringView string = get_string(parser);
+        long num;
+        if (!convert_num(string.data, string.data + string.length, &num)) {
+            parser_error(parser, "bass: invalid number `%.*s` at: %d:%zu\n",
+                         SV_FORMAT(string), parser->line,
+                         parser->start - parser->line_start + 1);
+            return false;
+        }
+        *value = num;
+        return true;
+    }
+    if (at_line_end(parser)) {
+        parser_error(parser, "bass: expected number or constant at end of "
+                             "line: %d:%zu\n",
+                     parser->line, get_col(parser));
+    } else {
+        parser_error(parser,
+                     "bass: expected number or constant, got `%c` at: %d:%zu\n",
+                     c, parser->line, get_col(parser) + 1);
+    }
+    return false;
+}
+
+// parses a string delimited by `"` for `.string`, `.incbin` and module paths,
+// handling the escapes \n, \t, \0, \\ and \"
+static bool parse_directive_string(Parser *parser, char **string,
+                                   size_t *length) {
+    skip_blanks(parser);
+    if (peek(parser) != '"') {
+        parser_error(parser, "bass: expected string literal at: %d:%zu\n",
+                     parser->line, get_col(parser) + 1);
+        return false;
+    }
+    next(parser);
+    parser->start = parser->end;
+    int line = parser->line;
+    size_t start = parser->start;
+
+    // the unescaped string is at most as long as the literal
+    size_t end = start;
+    while (end < parser->source.length && parser->source.data[end] != '"') {
+        end += (parser->source.data[end] == '\\') ? 2 : 1;
+    }
+    char *data = arena_alloc(&parser->arena, end - start + 1);
+    size_t size = 0;
+    char c;
+    while ((c = next(parser)) != '"') {
+        if (c == '\0') {
+            parser_error(parser,
+                         "bass: unterminated string literal at: %d:%zu\n",
+                         line, start);
+            return false;
+        }
+        if (c == '\n') {
+            parser->line_start = parser->end;
+            parser->line++;
+            parser->multiline = true;
+        } else if (c == '\\') {
+            switch (next(parser)) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case '0': c = '\0'; break;
+            case '\\': c = '\\'; break;
+            case '"': c = '"'; break;
+            default:
+                parser_error(parser,
+                             "bass: unknown escape sequence at: %d:%zu\n",
+                             parser->line, get_col(parser) - 1);
+                return false;
+            }
+        }
+        data[size++] = c;
+    }
+    data[size] = '\0';
+    *string = data;
+    *length = size;
+    return true;
+}
+
+static bool read_binary(Parser *parser, const char *path, unsigned char **bytes,
+                        size_t *size) {
+    // the path that was checked is the one that gets opened
+    char *canonical = NULL;
+    if (parser->root) {
+        canonical = realpath(path, NULL);
+        if (canonical && !path_inside(parser->root, canonical)) {
+            parser_error(parser, "bass: `%s` for `.incbin` at: %d is outside "
+                                 "of `%s`\n",
+                         path, parser->line, parser->root);
+            free(canonical);
+            return false;
+        }
+    }
+    FILE *file = fopen(canonical ? canonical : path, "rb");
+    free(canonical);
+    if (!file) {
+        parser_error(parser, "bass: failed to open `%s` for `.incbin` at: "
+                             "%d: %s\n",
+                     path, parser->line, strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    if (length < 0) {
+        parser_error(parser, "bass: couldnt read file position in `%s`: %s\n",
+                     path, strerror(errno));
+        fclose(file);
+        return false;
+    }
+    *bytes = arena_alloc(&parser->arena, length ? length : 1);
+    *size = fread(*bytes, 1, length, file);
+    fclose(file);
+    return true;
+}
+
+static inline void put_word(unsigned char *bytes, int64_t value) {
+    int32_t word = value;
+    memcpy(bytes, &word, sizeof(word));
+}
+
+// Parses the directives after the `.`:
+//     .equ NAME VALUE
+//     .data @ADDR VALUE, VALUE, ...   (32-bit words)
+//     .fill @ADDR COUNT, VALUE        (COUNT 32-bit words)
+//     .string @ADDR "..."             (bytes followed by a 0 byte)
+//     .incbin @ADDR "FILE"            (contents of FILE)
+//     .import "FILE"                  (links in the module FILE)
+//     .include "FILE"                 (places a copy of FILE's code here)
+//     .export LABEL, LABEL, ...
+// Values can be numbers or constants defined earlier with `.equ`. Modules are
+// only recorded here and get resolved by the linker.
+static bool parse_directive(Parser *parser, OpCodes *opcodes) {
+    int line = parser->line;
+    size_t col = get_col(parser);
+    parser->start = parser->end;
+    StringView name = parse_identifier(parser);
+
+    if (string_view_cstring_eq(name, "equ")) {
+        skip_blanks(parser);
+        parser->start = parser->end;
+        if (!is_alpha(peek(parser))) {
+            parser_error(parser, "bass: expected constant name after `.equ` "
+                                 "at: %d:%zu\n",
+                         parser->line, get_col(parser) + 1);
+            return false;
+        }
+        Constant constant = {parse_identifier(parser), 0};
+        int64_t existing;
+        if (find_constant(parser, constant.name, &existing)) {
+            parser_error(parser, "bass: constant `%.*s` redefined at: %d:%zu\n",
+                         SV_FORMAT(constant.name), line, col);
+            return false;
+        }
+        if (!parse_value(parser, &constant.value)) {
+            return false;
+        }
+        arena_dyn_append(&parser->arena, &parser->constants, constant);
+    } else if (string_view_cstring_eq(name, "data") ||
+               string_view_cstring_eq(name, "fill") ||
+               string_view_cstring_eq(name, "string") ||
+               string_view_cstring_eq(name, "incbin")) {
+        skip_blanks(parser);
+        if (next(parser) != '@') {
+            parser_error(parser, "bass: expected address after `.%.*s` at: "
+                                 "%d:%zu\n",
+                         SV_FORMAT(name), parser->line, get_col(parser));
+            return false;
+        }
+        int64_t address;
+        if (!parse_value(parser, &address)) {
+            return false;
+        }
+
+        DataSegment segment = {0};
+        segment.line = line;
+        if (string_view_cstring_eq(name, "data")) {
+            // values are collected before their count is known
+            struct {
+                int64_t *data;
+                size_t size;
+                size_t capacity;
+            } values = {0};
+            skip_separators(parser);
+            while (!at_line_end(parser)) {
+                int64_t value;
+                if (!parse_value(parser, &value)) {
+                    free(values.data);
+                    return false;
+                }
+                dyn_append(&values, value);
+                skip_separators(parser);
+            }
+            segment.size = values.size * sizeof(int32_t);
+            segment.bytes = arena_alloc(&parser->arena, segment.size + 1);
+            for (size_t i = 0; i < values.size; i++) {
+                put_word(&segment.bytes[i * sizeof(int32_t)], values.data[i]);
+            }
+            free(values.data);
+        } else if (string_view_cstring_eq(name, "fill")) {
+            int64_t count, value;
+            if (!parse_value(parser, &count) || !parse_value(parser, &value)) {
+                return false;
+            }
+            if (count < 0 || count > MEMORY_SIZE / (int64_t)sizeof(int32_t)) {
+                parser_error(parser, "bass: invalid `.fill` count `%" PRId64
+                                     "` at: %d:%zu\n",
+                             count, line, col);
+                return false;
+            }
+            segment.size = count * sizeof(int32_t);
+            segment.bytes = arena_alloc(&parser->arena, segment.size + 1);
+            for (int64_t i = 0; i < count; i++) {
+                put_word(&segment.bytes[i * sizeof(int32_t)], value);
+            }
+        } else if (string_view_cstring_eq(name, "string")) {
+            char *string;
+            size_t length;
+            if (!parse_directive_string(parser, &string, &length)) {
+                return false;
+            }
+            segment.bytes = (unsigned char *)string;
+            segment.size = length + 1;
+        } else {
+            char *path;
+            size_t length;
+            if (!parse_directive_string(parser, &path, &length) ||
+                !read_binary(parser, path, &segment.bytes, &segment.size)) {
+                return false;
+            }
+        }
+
+        if (address < 0 || address > MEMORY_SIZE ||
+            segment.size > (size_t)(MEMORY_SIZE - address)) {
+            parser_error(parser,
+                         "bass: `.%.*s` of %zu bytes at @%" PRId64
+                         " does not fit into memory of %d bytes at: %d:%zu\n",
+                         SV_FORMAT(name), segment.size, address, MEMORY_SIZE,
+                         line, col);
+            return false;
+        }
+        segment.address = address;
+        arena_dyn_append(&parser->arena, &parser->data, segment);
+    } else if (string_view_cstring_eq(name, "import") ||
+               string_view_cstring_eq(name, "include")) {
+        char *path;
+        size_t length;
+        if (!parse_directive_string(parser, &path, &length)) {
+            return false;
+        }
+        if (length == 0) {
+            parser_error(parser, "bass: empty module path at: %d:%zu\n", line,
+                         col);
+            return false;
+        }
+        Import import = {(StringView){path, length}, opcodes->size, false,
+                         line};
+        if (string_view_cstring_eq(name, "include")) {
+            // the included code is linked in right after this `nop`, which
+            // keeps the labels before and after the `.include` apart
+            import.inline_copy = true;
+            arena_dyn_grow(&parser->arena, opcodes);
+            opcodes->data[opcodes->size++] = (OpCode){line, OP_NO, col, {{0}}};
+        }
+        arena_dyn_append(&parser->arena, &parser->imports, import);
+    } else if (string_view_cstring_eq(name, "export")) {
+        skip_separators(parser);
+        if (at_line_end(parser)) {
+            parser_error(parser, "bass: expected label after `.export` at: "
+                                 "%d:%zu\n",
+                         parser->line, get_col(parser));
+            return false;
+        }
+        while (!at_line_end(parser)) {
+            parser->start = parser->end;
+            if (!is_alpha(peek(parser))) {
+                parser_error(parser, "bass: expected label, got `%c` at: "
+                                     "%d:%zu\n",
+                             peek(parser), parser->line, get_col(parser) + 1);
+                return false;
+            }
+            Export export = {parse_identifier(parser), parser->line};
+            arena_dyn_append(&parser->arena, &parser->exports, export);
+            skip_separators(parser);
+        }
+    } else {
+        parser_error(parser, "bass: unknown directive `.%.*s` at: %d:%zu\n",
+                     SV_FORMAT(name), line, col);
+        return false;
+    }
+
+    skip_blanks(parser);
+    if (!at_line_end(parser)) {
+        parser_error(parser, "bass: unexpected character `%c` at: %d:%zu\n",
+                     peek(parser), parser->line, get_col(parser) + 1);
+        return false;
+    }
     return true;
 }
 
 bool parse(Parser *parser, OpCodes *opcodes, Labels *labels) {
+    // every opcode takes up at least one line and every label needs a `:`
+    // so the output can be allocated upfront in most cases
+    if (opcodes->capacity == 0) {
+        arena_dyn_reserve(&parser->arena, opcodes,
+                          count_char(parser->source, '\n') + 1);
+    }
+    if (labels->capacity == 0) {
+        arena_dyn_reserve(&parser->arena, labels,
+                          count_char(parser->source, ':') + 1);
+    }
+
     char current;
-    size_t op_index = 0;
-    while ((current = next(parser))) {
-        if (isalpha(current)) {
+    while ((skip_blanks(parser), current = next(parser))) {
+        if (is_alpha(current)) {
             StringView string = parse_identifier(parser);
             char next_char = next(parser);
             // parse label
             if (next_char == ':') {
-                Label label = {string, op_index};
-                dyn_append(labels, label);
+                Label label = {string, opcodes->size, false};
+                arena_dyn_append(&parser->arena, labels, label);
 
                 // parse opcode
-            } else if ((isspace(next_char) || next_char == '\0')) {
-                OpCode opcode;
-                if (!parse_opcode(parser, string, &opcode)) {
+            } else if ((is_space(next_char) || next_char == '\0')) {
+                // parse straight into the output array
+                arena_dyn_grow(&parser->arena, opcodes);
+                if (!parse_opcode(parser, string,
+                                  &opcodes->data[opcodes->size])) {
                     return false;
                 }
-                dyn_append(opcodes, opcode);
-                op_index++;
+                opcodes->size++;
             } else {
-                fprintf(stderr, "bass: unexpected character `%c` at: %d:%zu\n",
-                        next_char, parser->line, get_col(parser));
+                parser_error(parser,
+                             "bass: unexpected character `%c` at: %d:%zu\n",
+                             next_char, parser->line, get_col(parser));
                 return false;
             }
             // skip comments
         } else if (current == ';') {
-            while ((next(parser)) != '\n')
-                ;
+            skip_comment(parser);
+        } else if (current == '.') {
+            if (!parse_directive(parser, opcodes)) {
+                return false;
+            }
         } else if (current == '\n') {
             parser->line_start = parser->end;
             parser->line++;
-        } else if (!(isspace(current) || current == '\0')) {
-            fprintf(stderr,
-                    "bass: expected opcode or label, got `%c` at: %d:%zu\n",
-                    current, parser->line, get_col(parser));
+        } else if (!(is_space(current) || current == '\0')) {
+            parser_error(
+                parser, "bass: expected opcode or label, got `%c` at: %d:%zu\n",
+                current, parser->line, get_col(parser));
             return false;
         }
         parser->start = parser->end;
@@ -339,61 +858,437 @@ bool parse(Parser *parser, OpCodes *opcodes, Labels *labels) {
     return true;
 }
 
-// TODO: Multiple labels with the same name causes only the first one to be
-// valid. Maybe make `Labels` a hashmap or set instead
-bool patch_labels(OpCodes *opcodes, Labels labels) {
-    for (size_t i = 0; i < opcodes->size; i++) {
-        bool found = false;
-        OpCode opcode = opcodes->data[i];
-        if (opcode.op == OP_JUMP || opcode.op == OP_JUMPZ ||
-            opcode.op == OP_JUMPG || opcode.op == OP_JUMPL) {
-            StringView opcode_label = opcode.operands[0].string;
-            for (size_t j = 0; j < labels.size; j++) {
-                if (string_view_eq(opcode_label, labels.data[j].name)) {
-                    opcodes->data[i].operands[0].value = labels.data[j].index;
-                    found = true;
-                    break;
-                }
+// sources smaller than this are not worth splitting up
+#define PARALLEL_MIN_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+    Parser parser;
+    OpCodes opcodes;
+    Labels labels;
+    bool ok;
+} Chunk;
+
+static void *parse_chunk(void *arg) {
+    Chunk *chunk = arg;
+    chunk->ok = parse(&chunk->parser, &chunk->opcodes, &chunk->labels);
+    return NULL;
+}
+
+// Splits the source into chunks at newlines and parses them on separate
+// threads. A chunk boundary that doesnt fall between two statements (inside a
+// multi-line string literal or operand list) makes the chunk before it fail,
+// and so does using a constant defined in an earlier chunk or defining it
+// again. In that case, or if the source has an actual error, it falls back to
+// `parse` over the whole source so that the output and errors are the same.
+bool parse_parallel(Parser *parser, OpCodes *opcodes, Labels *labels,
+                    int threads) {
+    StringView source = parser->source;
+    size_t max_threads = source.length / PARALLEL_MIN_CHUNK_SIZE;
+    if (threads > (int)max_threads) {
+        threads = max_threads;
+    }
+    if (threads <= 1 || opcodes->size != 0 || labels->size != 0) {
+        return parse(parser, opcodes, labels);
+    }
+
+    Chunk *chunks = calloc(threads, sizeof(Chunk));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    assert(chunks && workers && "Catastrophic Failure: Allocation failed!");
+
+    int count = 0;
+    size_t start = 0;
+    for (int i = 0; i < threads && start < source.length; i++) {
+        size_t end = source.length;
+        if (i < threads - 1) {
+            size_t split = source.length / threads * (i + 1);
+            if (split < start) {
+                split = start;
             }
-            if (!found) {
-                fprintf(stderr,
-                        "bass: couldnt find label: `%.*s` at opcode: `%s`\n",
-                        SV_FORMAT(opcode_label), OPCODES[opcode.op].name);
-                return false;
+            const char *newline =
+                memchr(&source.data[split], '\n', source.length - split);
+            if (newline) {
+                end = newline - source.data + 1;
+            }
+        }
+        Chunk *chunk = &chunks[count++];
+        parser_init(&chunk->parser,
+                    (StringView){&source.data[start], end - start});
+        chunk->parser.quiet = true;
+        chunk->parser.root = parser->root;
+        start = end;
+    }
+
+    // the first chunk is parsed on this thread
+    bool spawned = true;
+    for (int i = 1; i < count; i++) {
+        if (pthread_create(&workers[i], NULL, parse_chunk, &chunks[i]) != 0) {
+            spawned = false;
+            count = i;
+            break;
+        }
+    }
+    parse_chunk(&chunks[0]);
+    bool ok = spawned;
+    for (int i = 1; i < count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        ok = ok && chunks[i].ok;
+    }
+    // a constant defined again in a later chunk is only noticed here
+    for (int i = 0; ok && i < count; i++) {
+        Constants constants = chunks[i].parser.constants;
+        for (size_t j = 0; ok && j < constants.size; j++) {
+            ok = merge_constant(parser, constants.data[j]);
+        }
+    }
+    if (!ok) {
+        parser->constants = (Constants){0};
+    }
+
+    if (ok) {
+        size_t total_opcodes = 0, total_labels = 0;
+        for (int i = 0; i < count; i++) {
+            total_opcodes += chunks[i].opcodes.size;
+            total_labels += chunks[i].labels.size;
+        }
+        arena_dyn_reserve(&parser->arena, opcodes, total_opcodes + 1);
+        arena_dyn_reserve(&parser->arena, labels, total_labels + 1);
+
+        // line numbers and opcode indices start from the beginning of every
+        // chunk and are offset by everything before it
+        int line_offset = 0;
+        for (int i = 0; i < count; i++) {
+            Chunk *chunk = &chunks[i];
+            size_t op_offset = opcodes->size;
+            for (size_t j = 0; j < chunk->opcodes.size; j++) {
+                OpCode opcode = chunk->opcodes.data[j];
+                opcode.line += line_offset;
+                opcodes->data[opcodes->size++] = opcode;
+            }
+            for (size_t j = 0; j < chunk->labels.size; j++) {
+                Label label = chunk->labels.data[j];
+                label.index += op_offset;
+                labels->data[labels->size++] = label;
+            }
+            for (size_t j = 0; j < chunk->parser.data.size; j++) {
+                DataSegment segment = chunk->parser.data.data[j];
+                unsigned char *bytes =
+                    arena_alloc(&parser->arena, segment.size + 1);
+                memcpy(bytes, segment.bytes, segment.size);
+                segment.bytes = bytes;
+                segment.line += line_offset;
+                arena_dyn_append(&parser->arena, &parser->data, segment);
+            }
+            for (size_t j = 0; j < chunk->parser.imports.size; j++) {
+                Import import = chunk->parser.imports.data[j];
+                char *path = arena_alloc(&parser->arena, import.path.length);
+                memcpy(path, import.path.data, import.path.length);
+                import.path.data = path;
+                import.index += op_offset;
+                import.line += line_offset;
+                arena_dyn_append(&parser->arena, &parser->imports, import);
+            }
+            for (size_t j = 0; j < chunk->parser.exports.size; j++) {
+                Export export = chunk->parser.exports.data[j];
+                export.line += line_offset;
+                arena_dyn_append(&parser->arena, &parser->exports, export);
+            }
+            line_offset += chunk->parser.line - 1;
+            parser->multiline |= chunk->parser.multiline;
+        }
+        parser->end = parser->start = source.length;
+        parser->line += line_offset;
+    }
+
+    for (int i = 0; i < count; i++) {
+        parser_free(&chunks[i].parser);
+    }
+    free(chunks);
+    free(workers);
+    if (!ok) {
+        return parse(parser, opcodes, labels);
+    }
+    return true;
+}
+
+#define EDIT_BLOCK 64
+
+// where the views into the old source end up in the edited one
+typedef struct {
+    const char *old;
+    const char *new;
+    size_t old_length;
+    size_t old_end; // end of the edited region in the old source
+    size_t new_end;
+} Edit;
+
+static StringView edit_view(Edit *edit, StringView view) {
+    if (view.data < edit->old || view.data > edit->old + edit->old_length) {
+        return view;
+    }
+    size_t offset = view.data - edit->old;
+    if (offset >= edit->old_end) {
+        offset = offset - edit->old_end + edit->new_end;
+    }
+    return (StringView){edit->new + offset, view.length};
+}
+
+// moves opcodes copied from the old output by `shift` bytes and `lines`
+static void move_opcodes(OpCode *opcodes, size_t count, StringView old,
+                         ptrdiff_t shift, int lines) {
+    for (size_t i = 0; i < count; i++) {
+        OpCode *opcode = &opcodes[i];
+        for (int j = 0; j < MAX_OPERANDS; j++) {
+            StringView *string = &opcode->operands[j].string;
+            if (string->data >= old.data &&
+                string->data <= old.data + old.length) {
+                string->data += shift;
             }
         }
+        // jumps are resolved after parsing, their targets have to be reset
+        if (is_jump(opcode->op)) {
+            opcode->operands[0].value = -1;
+        }
+        opcode->line += lines;
+    }
+}
+
+// checks for anything that could be a directive, dots in comments or
+// strings only make the whole source be parsed
+static bool has_directive(const char *data, size_t length) {
+    return memchr(data, '.', length) != NULL;
+}
+
+// first opcode on `line` or after it, opcodes are in the order of their lines
+static size_t find_line(OpCodes opcodes, int line) {
+    size_t low = 0, high = opcodes.size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (opcodes.data[mid].line < line) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Parses the source of `parser` as an edit of the source that `old` parsed
+// into `old_opcodes` and `old_labels`. Only the lines between the first and
+// the last changed byte are parsed, everything before and after them is
+// copied from the old output with its lines and source views moved. That
+// only works when every statement is on a line of its own and the edit
+// doesnt touch any directives, otherwise (and on parse errors) it returns
+// false without reporting anything so that the whole source can be parsed.
+// Anything it already put into `parser` is freed by `parser_free`.
+bool parse_edit(Parser *parser, OpCodes *opcodes, Labels *labels, Parser *old,
+                OpCodes old_opcodes, Labels old_labels) {
+    StringView source = parser->source;
+    StringView old_source = old->source;
+    if (old->multiline || opcodes->size != 0 || labels->size != 0) {
+        return false;
+    }
+
+    // the edited region starts and ends at line boundaries
+    size_t min = (source.length < old_source.length) ? source.length
+                                                     : old_source.length;
+    // compared in blocks first, sources can be large and edits are small
+    size_t start = 0;
+    while (start + EDIT_BLOCK <= min &&
+           memcmp(&source.data[start], &old_source.data[start], EDIT_BLOCK) ==
+               0) {
+        start += EDIT_BLOCK;
+    }
+    while (start < min && source.data[start] == old_source.data[start]) {
+        start++;
+    }
+    while (start > 0 && source.data[start - 1] != '\n') {
+        start--;
+    }
+    size_t suffix = 0;
+    while (suffix + EDIT_BLOCK <= min - start &&
+           memcmp(&source.data[source.length - suffix - EDIT_BLOCK],
+                  &old_source.data[old_source.length - suffix - EDIT_BLOCK],
+                  EDIT_BLOCK) == 0) {
+        suffix += EDIT_BLOCK;
+    }
+    while (suffix < min - start &&
+           source.data[source.length - suffix - 1] ==
+               old_source.data[old_source.length - suffix - 1]) {
+        suffix++;
     }
+    Edit edit = {old_source.data, source.data, old_source.length,
+                 old_source.length - suffix, source.length - suffix};
+    while (edit.old_end < old_source.length && edit.old_end > 0 &&
+           old_source.data[edit.old_end - 1] != '\n') {
+        edit.old_end++;
+        edit.new_end++;
+    }
+    if (has_directive(&old_source.data[start], edit.old_end - start) ||
+        has_directive(&source.data[start], edit.new_end - start)) {
+        return false;
+    }
+
+    Parser region;
+    parser_init(&region,
+                (StringView){&source.data[start], edit.new_end - start});
+    region.quiet = true;
+    // only the constants defined before the region can be used in it
+    for (size_t i = 0; i < old->constants.size; i++) {
+        Constant constant = old->constants.data[i];
+        if (constant.name.data < &old_source.data[start]) {
+            constant.name = edit_view(&edit, constant.name);
+            arena_dyn_append(&region.arena, &region.constants, constant);
+        }
+    }
+    size_t constants = region.constants.size;
+    OpCodes region_opcodes = {0};
+    Labels region_labels = {0};
+    if (!parse(&region, &region_opcodes, &region_labels) || region.multiline ||
+        region.constants.size != constants) {
+        parser_free(&region);
+        return false;
+    }
+
+    // the lines and opcodes of the region, everything after it moves by the
+    // difference
+    int first_line = 1 + count_char((StringView){old_source.data, start}, '\n');
+    int old_lines = count_char(
+        (StringView){&old_source.data[start], edit.old_end - start}, '\n');
+    int line_shift = (region.line - 1) - old_lines;
+    size_t prefix = find_line(old_opcodes, first_line);
+    // the last line of the source doesnt end with a newline
+    size_t rest = (edit.old_end == old_source.length)
+                      ? old_opcodes.size
+                      : find_line(old_opcodes, first_line + old_lines);
+    size_t total = prefix + region_opcodes.size + (old_opcodes.size - rest);
+
+    arena_dyn_reserve(&parser->arena, opcodes, total + 1);
+    OpCode *data = opcodes->data;
+    memcpy(data, old_opcodes.data, prefix * sizeof(OpCode));
+    move_opcodes(data, prefix, old_source, edit.new - edit.old, 0);
+    data += prefix;
+    for (size_t i = 0; i < region_opcodes.size; i++) {
+        data[i] = region_opcodes.data[i];
+        data[i].line += first_line - 1;
+    }
+    data += region_opcodes.size;
+    memcpy(data, &old_opcodes.data[rest],
+           (old_opcodes.size - rest) * sizeof(OpCode));
+    move_opcodes(data, old_opcodes.size - rest, old_source,
+                 (edit.new + edit.new_end) - (edit.old + edit.old_end),
+                 line_shift);
+    opcodes->size = total;
+    assert(opcodes->size == total);
+
+    // labels are in the order of the source as well, the ones after the
+    // region move along with the opcodes
+    arena_dyn_reserve(&parser->arena, labels,
+                      old_labels.size + region_labels.size + 1);
+    size_t i = 0;
+    for (; i < old_labels.size &&
+           old_labels.data[i].name.data < &old_source.data[start];
+         i++) {
+        Label label = old_labels.data[i];
+        label.name = edit_view(&edit, label.name);
+        label.exported = false;
+        labels->data[labels->size++] = label;
+    }
+    for (size_t j = 0; j < region_labels.size; j++) {
+        Label label = region_labels.data[j];
+        label.index += prefix;
+        labels->data[labels->size++] = label;
+    }
+    for (; i < old_labels.size; i++) {
+        Label label = old_labels.data[i];
+        if (label.name.data < &old_source.data[edit.old_end]) {
+            continue;
+        }
+        label.name = edit_view(&edit, label.name);
+        label.index = label.index - rest + prefix + region_opcodes.size;
+        label.exported = false;
+        labels->data[labels->size++] = label;
+    }
+
+    // directives are all outside of the region
+    for (size_t i = 0; i < old->data.size; i++) {
+        DataSegment segment = old->data.data[i];
+        unsigned char *bytes = arena_alloc(&parser->arena, segment.size + 1);
+        memcpy(bytes, segment.bytes, segment.size);
+        segment.bytes = bytes;
+        if (segment.line >= first_line) {
+            segment.line += line_shift;
+        }
+        arena_dyn_append(&parser->arena, &parser->data, segment);
+    }
+    for (size_t i = 0; i < old->constants.size; i++) {
+        Constant constant = old->constants.data[i];
+        constant.name = edit_view(&edit, constant.name);
+        if (!merge_constant(parser, constant)) {
+            parser_free(&region);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < old->imports.size; i++) {
+        Import import = old->imports.data[i];
+        char *path = arena_alloc(&parser->arena, import.path.length);
+        memcpy(path, import.path.data, import.path.length);
+        import.path.data = path;
+        if (import.line >= first_line) {
+            import.index = import.index - rest + prefix + region_opcodes.size;
+            import.line += line_shift;
+        }
+        arena_dyn_append(&parser->arena, &parser->imports, import);
+    }
+    for (size_t i = 0; i < old->exports.size; i++) {
+        Export export = old->exports.data[i];
+        export.name = edit_view(&edit, export.name);
+        if (export.line >= first_line) {
+            export.line += line_shift;
+        }
+        arena_dyn_append(&parser->arena, &parser->exports, export);
+    }
+    parser->end = parser->start = source.length;
+    parser->line = old->line + line_shift;
+    parser_free(&region);
     return true;
 }
 
 void display_opcodes(OpCodes ops) {
     for (size_t i = 0; i < ops.size; i++) {
         OpCode op = ops.data[i];
-        printf("OpCode: %s\n", OPCODES[op.op].name);
+        if (OPCODES[op.op].width) {
+            printf("OpCode: %s (%d-bit)\n", OPCODES[op.op].name,
+                   OPCODES[op.op].width * 8);
+        } else {
+            printf("OpCode: %s\n", OPCODES[op.op].name);
+        }
         for (int i = 0; i < OPCODES[op.op].arity; i++) {
-            int val = op.operands[i].value;
+            int64_t val = op.operands[i].value;
             switch (op.operands[i].type) {
             case TOK_REGISTER:
-                printf("\tREGISTER: %d\n", val);
+                printf("\tREGISTER: %" PRId64 "\n", val);
                 break;
             case TOK_LITERAL_NUM:
-                printf("\tVALUE: %d\n", val);
+                printf("\tVALUE: %" PRId64 "\n", val);
                 break;
             case TOK_LITERAL_CHAR:
-                printf("\tVALUE: %c\n", val);
+                printf("\tVALUE: %c\n", (char)val);
                 break;
             case TOK_LITERAL_STR:
                 printf("\tVALUE: %.*s\n", SV_FORMAT(op.operands[0].string));
                 break;
             case TOK_ADDRESS:
-                printf("\tADDRESS: %d\n", val);
+                printf("\tADDRESS: %" PRId64 "\n", val);
                 break;
             case TOK_ADDRESS_REG:
-                printf("\tADDRESS AT REGISTER: %d\n", val);
+                printf("\tADDRESS AT REGISTER: %" PRId64 "\n", val);
                 break;
             case TOK_LABEL: {
                 StringView str = op.operands[i].string;
-                printf("\tLABEL: %.*s (to opcode: %d)\n", SV_FORMAT(str), val);
+                printf("\tLABEL: %.*s (to opcode: %" PRId64 ")\n",
+                       SV_FORMAT(str), val);
 
             } break;
             }
@@ -404,6 +1299,15 @@ void display_opcodes(OpCodes ops) {
 void display_labels(Labels lbls) {
     for (size_t i = 0; i < lbls.size; i++) {
         Label t = lbls.data[i];
-        printf("Label: %.*s (opcode: %zu)\n", SV_FORMAT(t.name), t.index);
+        printf("Label: %.*s (opcode: %zu%s)\n", SV_FORMAT(t.name), t.index,
+               t.exported ? ", exported" : "");
+    }
+}
+
+void display_data(DataSegments data) {
+    for (size_t i = 0; i < data.size; i++) {
+        DataSegment segment = data.data[i];
+        printf("Data: @%zu (%zu bytes, line: %d)\n", segment.address,
+               segment.size, segment.line);
     }
 }
@@ -1,15 +1,78 @@
 #ifndef BASS_PARSER_H
 #define BASS_PARSER_H
 
+#include <stdint.h>
+
 #include "constants.h"
 #include "utils.h"
 
+// bytes copied into memory before the program starts, from the `.data`,
+// `.fill`, `.string` and `.incbin` directives
+typedef struct {
+    size_t address;
+    unsigned char *bytes;
+    size_t size;
+    int line;
+} DataSegment;
+
+typedef struct {
+    DataSegment *data;
+    size_t size;
+    size_t capacity;
+} DataSegments;
+
+// named value defined with `.equ`
+typedef struct {
+    StringView name;
+    int64_t value;
+} Constant;
+
+typedef struct {
+    Constant *data;
+    size_t size;
+    size_t capacity;
+} Constants;
+
+// module pulled in with `.import` or `.include`
+typedef struct {
+    StringView path;
+    size_t index; // index of the `nop` that an `.include` is placed after
+    bool inline_copy; // `.include` places a copy of the module's code inline
+    int line;
+} Import;
+
+typedef struct {
+    Import *data;
+    size_t size;
+    size_t capacity;
+} Imports;
+
+// label made visible to other modules with `.export`
+typedef struct {
+    StringView name;
+    int line;
+} Export;
+
+typedef struct {
+    Export *data;
+    size_t size;
+    size_t capacity;
+} Exports;
+
 typedef struct {
     StringView source;
     size_t start;
     size_t end;
     size_t line_start;
     int line;
+    Arena arena; // backs the parsed opcodes, labels and data segments
+    bool quiet;  // dont report errors (used by the parallel parser)
+    bool multiline; // a statement spans several lines, see `parse_edit`
+    const char *root; // `.incbin` can only read files inside of it when set
+    DataSegments data;
+    Constants constants;
+    Imports imports;
+    Exports exports;
 } Parser;
 
 typedef enum {
@@ -42,6 +105,14 @@ typedef enum {
     OP_MOVE,
     OP_LOAD,
     OP_STORE,
+    OP_LOADB,
+    OP_LOADH,
+    OP_LOADW,
+    OP_LOADQ,
+    OP_STOREB,
+    OP_STOREH,
+    OP_STOREW,
+    OP_STOREQ,
     OP_PRINT,
     OP_PRINTLN,
     OP_PUSH,
@@ -51,6 +122,7 @@ typedef enum {
     OP_JUMPZ,
     OP_JUMPG,
     OP_JUMPL,
+    OP_YIELD,
 
     OP_COUNT
 } OpType;
@@ -58,6 +130,7 @@ typedef enum {
 typedef struct {
     const char *name;
     int arity; // no of arguments it takes
+    int width; // size in bytes of the memory accessed by load/store opcodes
 } OpCodeData;
 
 static const OpCodeData OPCODES[OP_COUNT] = {
@@ -68,8 +141,16 @@ static const OpCodeData OPCODES[OP_COUNT] = {
     [OP_DIV] = {.name = "div", .arity = 3},
     [OP_MOD] = {.name = "mod", .arity = 3},
     [OP_MOVE] = {.name = "move", .arity = 2},
-    [OP_LOAD] = {.name = "load", .arity = 2},
-    [OP_STORE] = {.name = "store", .arity = 2},
+    [OP_LOAD] = {.name = "load", .arity = 2, .width = 4},
+    [OP_STORE] = {.name = "store", .arity = 2, .width = 4},
+    [OP_LOADB] = {.name = "loadb", .arity = 2, .width = 1},
+    [OP_LOADH] = {.name = "loadh", .arity = 2, .width = 2},
+    [OP_LOADW] = {.name = "loadw", .arity = 2, .width = 4},
+    [OP_LOADQ] = {.name = "loadq", .arity = 2, .width = 8},
+    [OP_STOREB] = {.name = "storeb", .arity = 2, .width = 1},
+    [OP_STOREH] = {.name = "storeh", .arity = 2, .width = 2},
+    [OP_STOREW] = {.name = "storew", .arity = 2, .width = 4},
+    [OP_STOREQ] = {.name = "storeq", .arity = 2, .width = 8},
     [OP_PRINT] = {.name = "print", .arity = 1},
     [OP_PRINTLN] = {.name = "println", .arity = 1},
     [OP_PUSH] = {.name = "push", .arity = 1},
@@ -78,18 +159,25 @@ static const OpCodeData OPCODES[OP_COUNT] = {
     [OP_JUMP] = {.name = "jump", .arity = 1},
     [OP_JUMPZ] = {.name = "jumpz", .arity = 1},
     [OP_JUMPG] = {.name = "jumpg", .arity = 1},
-    [OP_JUMPL] = {.name = "jumpl", .arity = 1}};
+    [OP_JUMPL] = {.name = "jumpl", .arity = 1},
+    [OP_YIELD] = {.name = "yield", .arity = 0}};
+
+static inline bool is_jump(OpType op) {
+    return op == OP_JUMP || op == OP_JUMPZ || op == OP_JUMPG || op == OP_JUMPL;
+}
 
+// fields are ordered to avoid padding, parsed programs can have millions of
+// opcodes
 typedef struct {
     TokenType type;
+    int64_t value;
     StringView string;
-    int value;
 } Operand;
 
 typedef struct {
     int line;
-    size_t col;
     OpType op;
+    size_t col;
     Operand operands[MAX_OPERANDS];
 } OpCode;
 
@@ -102,6 +190,7 @@ typedef struct {
 typedef struct {
     StringView name;
     size_t index; // index of next opcode
+    bool exported;
 } Label;
 
 typedef struct {
@@ -127,11 +216,28 @@ static inline void parser_init(Parser *parser, StringView source_code) {
     parser->end = 0;
     parser->line_start = 0;
     parser->line = 1;
+    parser->arena = (Arena){0};
+    parser->quiet = false;
+    parser->multiline = false;
+    parser->root = NULL;
+    parser->data = (DataSegments){0};
+    parser->constants = (Constants){0};
+    parser->imports = (Imports){0};
+    parser->exports = (Exports){0};
+}
+
+// frees the opcodes and labels produced by `parse`
+static inline void parser_free(Parser *parser) {
+    arena_free(&parser->arena);
 }
 
 bool parse(Parser *parser, OpCodes *opcodes, Labels *labels);
-bool patch_labels(OpCodes *opcodes, Labels labels);
+bool parse_parallel(Parser *parser, OpCodes *opcodes, Labels *labels,
+                    int threads);
+bool parse_edit(Parser *parser, OpCodes *opcodes, Labels *labels, Parser *old,
+                OpCodes old_opcodes, Labels old_labels);
 void display_opcodes(OpCodes ops);
 void display_labels(Labels ops);
+void display_data(DataSegments data);
 
 #endif
@@ -0,0 +1,506 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "interpreter.h"
+#include "options.h"
+#include "parser.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "utils.h"
+
+typedef struct VM {
+    State state;
+    Output output;
+    VMStats stats;
+    size_t id;
+    bool finished;   // ran to the end (or failed) and only has to be flushed
+    bool failed;
+    struct VM *next; // in the queue of the output thread
+} VM;
+
+// Ring buffer of the runnable VMs of a worker. The worker takes VMs from the
+// head and puts them back at the tail, other workers steal from the tail when
+// they run out of work.
+typedef struct {
+    pthread_mutex_t lock;
+    VM **data;
+    size_t capacity; // every VM fits
+    size_t head;
+    size_t size;
+} RunQueue;
+
+struct Scheduler;
+
+typedef struct {
+    struct Scheduler *scheduler;
+    RunQueue queue;
+    pthread_t thread;
+    unsigned seed; // picks the first worker to steal from
+} Worker;
+
+typedef struct Scheduler {
+    OpCodes opcodes;
+    size_t quantum;
+    Worker *workers;
+    size_t worker_count;
+    VM *vms;
+    size_t vm_count;
+    unsigned char *memory; // memory of every VM, one after another
+    atomic_size_t live;    // VMs that havent finished
+    atomic_size_t next_worker; // gets the next VM that was done waiting
+    atomic_bool failed;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle; // VMs were queued or all of them finished
+
+    // VMs whose output has to be written, by the output thread
+    pthread_mutex_t output_lock;
+    pthread_cond_t output_ready;
+    VM *output_head;
+    VM *output_tail;
+    bool stopping;
+} Scheduler;
+
+static void queue_init(RunQueue *queue, size_t capacity) {
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->data = malloc(capacity * sizeof(VM *));
+    assert(queue->data && "Catastrophic Failure: Allocation failed!");
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->size = 0;
+}
+
+static void queue_free(RunQueue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->data);
+}
+
+static void queue_push(RunQueue *queue, VM *vm) {
+    pthread_mutex_lock(&queue->lock);
+    queue->data[(queue->head + queue->size++) % queue->capacity] = vm;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static VM *queue_pop(RunQueue *queue) {
+    VM *vm = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->size) {
+        vm = queue->data[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->size--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return vm;
+}
+
+// takes up to half of the VMs from the tail of `queue`
+static size_t queue_steal(RunQueue *queue, VM *stolen[GREEN_STEAL_BATCH]) {
+    pthread_mutex_lock(&queue->lock);
+    size_t count = (queue->size + 1) / 2;
+    if (count > GREEN_STEAL_BATCH) {
+        count = GREEN_STEAL_BATCH;
+    }
+    for (size_t i = 0; i < count; i++) {
+        queue->size--;
+        stolen[i] = queue->data[(queue->head + queue->size) % queue->capacity];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+static void wake_workers(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->idle_lock);
+    pthread_cond_broadcast(&scheduler->idle);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+}
+
+static void finish_vm(Scheduler *scheduler, VM *vm) {
+    free(vm->output.data);
+    vm->output = (Output){0};
+    if (atomic_fetch_sub(&scheduler->live, 1) == 1) {
+        wake_workers(scheduler);
+    }
+}
+
+// hands the VM over to the output thread, it is queued again (or finished)
+// once its output has been written
+static void park_vm(Scheduler *scheduler, VM *vm) {
+    vm->next = NULL;
+    pthread_mutex_lock(&scheduler->output_lock);
+    if (scheduler->output_tail) {
+        scheduler->output_tail->next = vm;
+    } else {
+        scheduler->output_head = vm;
+    }
+    scheduler->output_tail = vm;
+    pthread_cond_signal(&scheduler->output_ready);
+    pthread_mutex_unlock(&scheduler->output_lock);
+}
+
+// writes the output up to the last complete line, unless `all` is set or
+// there is no complete line
+static void write_output(Output *output, bool all) {
+    size_t size = output->size;
+    if (!all) {
+        while (size > 0 && output->data[size - 1] != '\n') {
+            size--;
+        }
+        if (size == 0) {
+            size = output->size;
+        }
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(STDOUT_FILENO, &output->data[written],
+                          size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    memmove(output->data, &output->data[size], output->size - size);
+    output->size -= size;
+}
+
+// Writes the output of parked VMs so that a slow stdout only holds up the VMs
+// that print to it. Output is written a line at a time, so the output of
+// different VMs is only interleaved between lines (or buffers, for lines
+// longer than a buffer).
+static void *output_thread(void *arg) {
+    Scheduler *scheduler = arg;
+    pthread_mutex_lock(&scheduler->output_lock);
+    while (true) {
+        while (!scheduler->output_head && !scheduler->stopping) {
+            pthread_cond_wait(&scheduler->output_ready,
+                              &scheduler->output_lock);
+        }
+        VM *vm = scheduler->output_head;
+        if (!vm) {
+            break;
+        }
+        scheduler->output_head = vm->next;
+        if (!scheduler->output_head) {
+            scheduler->output_tail = NULL;
+        }
+        pthread_mutex_unlock(&scheduler->output_lock);
+
+        write_output(&vm->output, vm->finished);
+        if (vm->finished) {
+            finish_vm(scheduler, vm);
+        } else {
+            size_t next = atomic_fetch_add(&scheduler->next_worker, 1);
+            Worker *worker = &scheduler->workers[next % scheduler->worker_count];
+            queue_push(&worker->queue, vm);
+            wake_workers(scheduler);
+        }
+        pthread_mutex_lock(&scheduler->output_lock);
+    }
+    pthread_mutex_unlock(&scheduler->output_lock);
+    return NULL;
+}
+
+static VM *find_work(Worker *worker) {
+    VM *vm = queue_pop(&worker->queue);
+    Scheduler *scheduler = worker->scheduler;
+    if (vm || scheduler->worker_count == 1) {
+        return vm;
+    }
+    VM *stolen[GREEN_STEAL_BATCH];
+    size_t start = rand_r(&worker->seed) % scheduler->worker_count;
+    for (size_t i = 0; i < scheduler->worker_count; i++) {
+        Worker *victim =
+            &scheduler->workers[(start + i) % scheduler->worker_count];
+        if (victim == worker) {
+            continue;
+        }
+        size_t count = queue_steal(&victim->queue, stolen);
+        if (count == 0) {
+            continue;
+        }
+        for (size_t j = 0; j < count; j++) {
+            stolen[j]->stats.steals++;
+            if (j > 0) {
+                queue_push(&worker->queue, stolen[j]);
+            }
+        }
+        return stolen[0];
+    }
+    return NULL;
+}
+
+static void run_vm(Worker *worker, VM *vm) {
+    Scheduler *scheduler = worker->scheduler;
+    State *state = &vm->state;
+    vm->stats.slices++;
+    switch (interpret_slice(state, scheduler->opcodes, scheduler->quantum)) {
+    case RUN_YIELD:
+        vm->stats.yields++;
+        queue_push(&worker->queue, vm);
+        break;
+    case RUN_PREEMPTED:
+        vm->stats.preemptions++;
+        queue_push(&worker->queue, vm);
+        break;
+    case RUN_BLOCKED:
+        if (vm->output.size == 0) {
+            // the buffer is allocated by the first print, a print that
+            // doesnt fit into an empty buffer gets one of its own size
+            size_t size = print_size(&scheduler->opcodes.data[state->reg_pc]);
+            vm->output.capacity =
+                (size > GREEN_OUTPUT_SIZE) ? size : GREEN_OUTPUT_SIZE;
+            vm->output.data = realloc(vm->output.data, vm->output.capacity);
+            assert(vm->output.data &&
+                   "Catastrophic Failure: Allocation failed!");
+            queue_push(&worker->queue, vm);
+        } else {
+            vm->stats.parks++;
+            park_vm(scheduler, vm);
+        }
+        break;
+    case RUN_ERROR:
+        fprintf(stderr, "bass: green thread %zu failed\n", vm->id);
+        vm->failed = true;
+        atomic_store(&scheduler->failed, true);
+        // fallthrough
+    case RUN_DONE:
+        vm->finished = true;
+        if (vm->output.size) {
+            park_vm(scheduler, vm);
+        } else {
+            finish_vm(scheduler, vm);
+        }
+        break;
+    }
+}
+
+static void *worker_thread(void *arg) {
+    Worker *worker = arg;
+    Scheduler *scheduler = worker->scheduler;
+    while (atomic_load(&scheduler->live) > 0) {
+        VM *vm = find_work(worker);
+        if (vm) {
+            run_vm(worker, vm);
+            continue;
+        }
+        // the timeout covers VMs that were queued by other workers, which
+        // dont wake anyone up
+        pthread_mutex_lock(&scheduler->idle_lock);
+        if (atomic_load(&scheduler->live) > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&scheduler->idle, &scheduler->idle_lock,
+                                   &deadline);
+        }
+        pthread_mutex_unlock(&scheduler->idle_lock);
+    }
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// prints the min, median and max of `values`, sorting them
+static void report_spread(const char *name, uint64_t *values, size_t count) {
+    qsort(values, count, sizeof(uint64_t), compare_u64);
+    fprintf(stderr, "  %-28s %" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n", name,
+            values[0], values[count / 2], values[count - 1]);
+}
+
+static void report(Scheduler *scheduler, Stats *stats) {
+    VMStats total = {0};
+    uint64_t *retired = malloc(scheduler->vm_count * sizeof(uint64_t));
+    uint64_t *slices = malloc(scheduler->vm_count * sizeof(uint64_t));
+    assert(retired && slices && "Catastrophic Failure: Allocation failed!");
+    uint64_t total_retired = 0;
+    for (size_t i = 0; i < scheduler->vm_count; i++) {
+        VM *vm = &scheduler->vms[i];
+        total.slices += vm->stats.slices;
+        total.yields += vm->stats.yields;
+        total.preemptions += vm->stats.preemptions;
+        total.parks += vm->stats.parks;
+        total.steals += vm->stats.steals;
+        retired[i] = vm->state.retired;
+        slices[i] = vm->stats.slices;
+        total_retired += vm->state.retired;
+    }
+    stats_report(stats, total_retired);
+
+    fprintf(stderr, "bass: %zu green threads on %zu workers (quantum: %zu):\n",
+            scheduler->vm_count, scheduler->worker_count, scheduler->quantum);
+    fprintf(stderr, "  %-28s %" PRIu64 "\n", "context switches", total.slices);
+    if (stats->wall > 0) {
+        fprintf(stderr, "  %-28s %.0f\n", "context switches per second",
+                total.slices / stats->wall);
+    }
+    fprintf(stderr, "  %-28s %" PRIu64 "\n", "yields", total.yields);
+    fprintf(stderr, "  %-28s %" PRIu64 "\n", "preemptions", total.preemptions);
+    fprintf(stderr, "  %-28s %" PRIu64 "\n", "parked on output", total.parks);
+    fprintf(stderr, "  %-28s %" PRIu64 "\n", "stolen", total.steals);
+
+    if (scheduler->vm_count <= GREEN_REPORT_VMS) {
+        fprintf(stderr, "  %-6s %12s %9s %9s %9s %9s %9s\n", "vm", "opcodes",
+                "switches", "yields", "preempted", "parked", "stolen");
+        for (size_t i = 0; i < scheduler->vm_count; i++) {
+            VM *vm = &scheduler->vms[i];
+            fprintf(stderr,
+                    "  %-6zu %12zu %9" PRIu64 " %9" PRIu64 " %9" PRIu64
+                    " %9" PRIu64 " %9" PRIu64 "%s\n",
+                    vm->id, vm->state.retired, vm->stats.slices,
+                    vm->stats.yields, vm->stats.preemptions, vm->stats.parks,
+                    vm->stats.steals, vm->failed ? " (failed)" : "");
+        }
+    } else {
+        fprintf(stderr, "  per green thread (min / median / max):\n");
+        report_spread("opcodes", retired, scheduler->vm_count);
+        report_spread("context switches", slices, scheduler->vm_count);
+    }
+    free(retired);
+    free(slices);
+}
+
+static bool setup_vms(Scheduler *scheduler, DataSegments data,
+                      const Loops *loops, Options *options) {
+    for (size_t i = 0; i < scheduler->vm_count; i++) {
+        VM *vm = &scheduler->vms[i];
+        State *state = &vm->state;
+        vm->id = i;
+        state->memory = &scheduler->memory[i * MEMORY_SIZE];
+        state->wide = options->wide;
+        state->output = &vm->output;
+        state->loops = loops;
+        state->registers[0] = i;
+        state_load_image(state, data);
+        for (size_t j = 0; j < options->mappings.size; j++) {
+            if (!state_map_file(state, options->mappings.data[j])) {
+                return false;
+            }
+        }
+        Worker *worker = &scheduler->workers[i % scheduler->worker_count];
+        queue_push(&worker->queue, vm);
+    }
+    return true;
+}
+
+bool run_green(OpCodes opcodes, DataSegments data, const Loops *loops,
+               Options *options) {
+    Scheduler scheduler = {0};
+    scheduler.opcodes = opcodes;
+    scheduler.quantum = options->quantum;
+    scheduler.vm_count = options->green;
+    scheduler.worker_count = options->jobs;
+    if (scheduler.worker_count > scheduler.vm_count) {
+        scheduler.worker_count = scheduler.vm_count;
+    }
+
+    // States are zeroed by calloc and the memory of every VM comes from a
+    // single mapping that isnt backed until it is touched, so idle VMs only
+    // cost the pages of their registers
+    scheduler.vms = calloc(scheduler.vm_count, sizeof(VM));
+    scheduler.memory =
+        mmap(NULL, scheduler.vm_count * (size_t)MEMORY_SIZE,
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+             -1, 0);
+    if (!scheduler.vms || scheduler.memory == MAP_FAILED) {
+        fprintf(stderr, "bass: failed to allocate %zu green threads\n",
+                scheduler.vm_count);
+        if (scheduler.memory != MAP_FAILED) {
+            munmap(scheduler.memory, scheduler.vm_count * (size_t)MEMORY_SIZE);
+        }
+        free(scheduler.vms);
+        return false;
+    }
+    scheduler.workers = calloc(scheduler.worker_count, sizeof(Worker));
+    assert(scheduler.workers && "Catastrophic Failure: Allocation failed!");
+    for (size_t i = 0; i < scheduler.worker_count; i++) {
+        scheduler.workers[i].scheduler = &scheduler;
+        scheduler.workers[i].seed = i + 1;
+        queue_init(&scheduler.workers[i].queue, scheduler.vm_count);
+    }
+    atomic_init(&scheduler.live, scheduler.vm_count);
+    atomic_init(&scheduler.next_worker, 0);
+    atomic_init(&scheduler.failed, false);
+    pthread_mutex_init(&scheduler.idle_lock, NULL);
+    pthread_cond_init(&scheduler.idle, NULL);
+    pthread_mutex_init(&scheduler.output_lock, NULL);
+    pthread_cond_init(&scheduler.output_ready, NULL);
+
+    bool ok = setup_vms(&scheduler, data, loops, options);
+    if (ok) {
+        Stats stats;
+        if (options->stats) {
+            stats_start(&stats, "green threads");
+        }
+        // anything printed so far has to come before the output of the VMs
+        fflush(stdout);
+        pthread_t output;
+        bool output_started =
+            pthread_create(&output, NULL, output_thread, &scheduler) == 0;
+        size_t started = 0;
+        while (output_started && started < scheduler.worker_count) {
+            Worker *worker = &scheduler.workers[started];
+            if (pthread_create(&worker->thread, NULL, worker_thread,
+                               worker) != 0) {
+                break;
+            }
+            started++;
+        }
+        // the workers that did start steal the VMs of the others
+        if (started == 0) {
+            fprintf(stderr, "bass: failed to start green thread workers\n");
+            ok = false;
+        }
+        for (size_t i = 0; i < started; i++) {
+            pthread_join(scheduler.workers[i].thread, NULL);
+        }
+        if (output_started) {
+            pthread_mutex_lock(&scheduler.output_lock);
+            scheduler.stopping = true;
+            pthread_cond_signal(&scheduler.output_ready);
+            pthread_mutex_unlock(&scheduler.output_lock);
+            pthread_join(output, NULL);
+        }
+        ok = ok && !atomic_load(&scheduler.failed);
+        if (options->stats && started) {
+            stats_stop(&stats);
+            report(&scheduler, &stats);
+        } else if (options->stats) {
+            stats_cancel(&stats);
+        }
+    }
+
+    for (size_t i = 0; i < scheduler.vm_count; i++) {
+        free(scheduler.vms[i].state.mappings.data);
+        free(scheduler.vms[i].output.data);
+    }
+    for (size_t i = 0; i < scheduler.worker_count; i++) {
+        queue_free(&scheduler.workers[i].queue);
+    }
+    // unmapping the whole region also flushes back any `rw` file mappings
+    munmap(scheduler.memory, scheduler.vm_count * (size_t)MEMORY_SIZE);
+    pthread_mutex_destroy(&scheduler.idle_lock);
+    pthread_cond_destroy(&scheduler.idle);
+    pthread_mutex_destroy(&scheduler.output_lock);
+    pthread_cond_destroy(&scheduler.output_ready);
+    free(scheduler.workers);
+    free(scheduler.vms);
+    return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef BASS_SCHEDULER_H
+#define BASS_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "loops.h"
+#include "options.h"
+#include "parser.h"
+
+#define GREEN_QUANTUM 10000     // default for `--quantum`
+#define GREEN_OUTPUT_SIZE 1024  // output buffered by a VM before it parks
+#define GREEN_STEAL_BATCH 32    // most VMs taken from another worker at once
+#define GREEN_REPORT_VMS 16     // VMs listed one by one in the stats report
+
+typedef struct {
+    uint64_t slices;      // times the VM was scheduled
+    uint64_t yields;
+    uint64_t preemptions;
+    uint64_t parks;       // times it waited for its output to be written
+    uint64_t steals;      // times another worker took it
+} VMStats;
+
+// Runs `options->green` copies of the program on `options->jobs` worker
+// threads, the copies start with their index in `r0`. Context switches
+// between the VMs simply hand another `State` to the interpreter.
+bool run_green(OpCodes opcodes, DataSegments data, const Loops *loops,
+               Options *options);
+
+#endif
@@ -0,0 +1,795 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interpreter.h"
+#include "linker.h"
+#include "options.h"
+#include "parser.h"
+#include "server.h"
+#include "utils.h"
+
+extern char **environ;
+
+// a compiled program by the hash of its source, the modules that it imports
+// are cached separately and linked in for every request
+typedef struct {
+    bool used;
+    uint64_t hash;
+    size_t length;
+    Module *module; // owns the source
+} CachedProgram;
+
+typedef struct {
+    CachedProgram entries[SERVER_CACHE_SIZE];
+    size_t next; // entry evicted on the next miss
+} ProgramCache;
+
+typedef struct {
+    int64_t registers[REG_COUNT];
+    bool set[REG_COUNT];
+    char *name; // path of the program or `<source>`
+    char *source;
+    size_t length;
+} Request;
+
+typedef struct {
+    int fd;
+    char data[4096];
+    size_t start;
+    size_t end;
+} Reader;
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    int client;
+    int out; // read ends of the pipes that stdout and stderr point to
+    int err;
+} Relay;
+
+static void buffer_append(Buffer *buffer, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dyn_append(buffer, data[i]);
+    }
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+    const char *cur = data;
+    while (size > 0) {
+        ssize_t n = send(fd, cur, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cur += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+    char *cur = data;
+    while (size > 0) {
+        ssize_t n = read(fd, cur, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        cur += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool send_frame(int fd, char type, const void *data, uint32_t length) {
+    char header[1 + sizeof(uint32_t)];
+    header[0] = type;
+    memcpy(&header[1], &length, sizeof(length));
+    return write_all(fd, header, sizeof(header)) &&
+           write_all(fd, data, length);
+}
+
+// forwards everything written to stdout and stderr to the client until both
+// pipes are closed
+static void *relay_output(void *arg) {
+    Relay *relay = arg;
+    struct pollfd fds[2] = {{relay->out, POLLIN, 0}, {relay->err, POLLIN, 0}};
+    const char types[2] = {FRAME_STDOUT, FRAME_STDERR};
+    bool connected = true;
+    char buffer[64 * 1024];
+    int open = 2;
+    while (open > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents) {
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                fds[i].fd = -1;
+                open--;
+                continue;
+            }
+            // keep draining after the client goes away so that the program
+            // doesnt block on a full pipe
+            if (connected) {
+                connected = send_frame(relay->client, types[i], buffer, n);
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool reader_fill(Reader *reader) {
+    if (reader->start == reader->end) {
+        reader->start = reader->end = 0;
+    }
+    if (reader->end == sizeof(reader->data)) {
+        return false;
+    }
+    ssize_t n;
+    do {
+        n = read(reader->fd, &reader->data[reader->end],
+                 sizeof(reader->data) - reader->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    reader->end += n;
+    return true;
+}
+
+// reads a line without the newline, lines longer than the buffer fail
+static bool reader_line(Reader *reader, char *line, size_t capacity) {
+    while (true) {
+        char *start = &reader->data[reader->start];
+        char *newline = memchr(start, '\n', reader->end - reader->start);
+        if (newline) {
+            size_t length = newline - start;
+            if (length >= capacity) {
+                return false;
+            }
+            memcpy(line, start, length);
+            line[length] = '\0';
+            reader->start += length + 1;
+            return true;
+        }
+        if (reader->start > 0) {
+            memmove(reader->data, start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        if (!reader_fill(reader)) {
+            return false;
+        }
+    }
+}
+
+static bool reader_bytes(Reader *reader, char *data, size_t size) {
+    size_t buffered = reader->end - reader->start;
+    size_t n = (buffered < size) ? buffered : size;
+    memcpy(data, &reader->data[reader->start], n);
+    reader->start += n;
+    return read_all(reader->fd, data + n, size - n);
+}
+
+// reads the program at `path`, which has to be inside of `root`
+static bool read_path(Request *request, const char *path, const char *root) {
+    char *canonical = realpath(path, NULL);
+    struct stat st;
+    if (!canonical || stat(canonical, &st) < 0) {
+        fprintf(stderr, "bass: failed to open source file `%s`: %s\n", path,
+                strerror(errno));
+        free(canonical);
+        return false;
+    }
+    bool ok = false;
+    StringView source;
+    if (!path_inside(root, canonical)) {
+        fprintf(stderr, "bass: `%s` is outside of `%s`\n", path, root);
+    } else if (st.st_size > SERVER_MAX_SOURCE) {
+        fprintf(stderr, "bass: `%s` is larger than the limit of %d bytes\n",
+                path, SERVER_MAX_SOURCE);
+    } else if (read_to_string(canonical, &source)) {
+        request->source = (char *)source.data;
+        request->length = source.length;
+        ok = true;
+    }
+    free(canonical);
+    return ok;
+}
+
+static bool read_request(int client, Request *request, const char *root) {
+    memset(request, 0, sizeof(*request));
+    Reader reader = {.fd = client};
+    char line[PATH_MAX + 16];
+    while (reader_line(&reader, line, sizeof(line))) {
+        int reg;
+        long long value;
+        size_t length;
+        if (sscanf(line, "reg %d %lld", &reg, &value) == 2) {
+            if (reg < 0 || REG_COUNT <= reg) {
+                fprintf(stderr,
+                        "bass: invalid register `%d` in request\n"
+                        "help: registers can range from 0 to %d\n",
+                        reg, REG_COUNT - 1);
+                return false;
+            }
+            request->registers[reg] = value;
+            request->set[reg] = true;
+        } else if (strncmp(line, "path ", 5) == 0) {
+            request->name = strdup(&line[5]);
+            return read_path(request, &line[5], root);
+        } else if (sscanf(line, "source %zu", &length) == 1) {
+            if (length > SERVER_MAX_SOURCE) {
+                fprintf(stderr,
+                        "bass: source of %zu bytes is larger than the limit "
+                        "of %d bytes\n",
+                        length, SERVER_MAX_SOURCE);
+                return false;
+            }
+            request->name = strdup("<source>");
+            request->source = malloc(length + 1);
+            assert(request->source &&
+                   "Catastrophic Failure: Allocation failed!");
+            if (!reader_bytes(&reader, request->source, length)) {
+                fprintf(stderr, "bass: request ended before the source\n");
+                return false;
+            }
+            request->source[length] = '\0';
+            request->length = length;
+            return true;
+        } else {
+            fprintf(stderr, "bass: invalid request line `%s`\n", line);
+            return false;
+        }
+    }
+    fprintf(stderr, "bass: incomplete request\n");
+    return false;
+}
+
+static void evict_program(CachedProgram *program) {
+    if (program->used) {
+        module_free(program->module);
+    }
+    memset(program, 0, sizeof(*program));
+}
+
+// returns the compiled program for `source`, taking ownership of it. Imports
+// are relative to the directory in `name`, so it is a part of the key as well
+static Module *get_program(ProgramCache *cache, ModuleCache *modules,
+                           const char *name, char *source, size_t length) {
+    uint64_t hash = string_view_hash((StringView){source, length});
+    for (size_t i = 0; i < SERVER_CACHE_SIZE; i++) {
+        CachedProgram *program = &cache->entries[i];
+        if (program->used && program->hash == hash &&
+            program->length == length &&
+            memcmp(program->module->source, source, length) == 0 &&
+            strcmp(program->module->name, name) == 0) {
+            free(source);
+            return program->module;
+        }
+    }
+
+    CachedProgram *program = &cache->entries[cache->next];
+    evict_program(program);
+    program->module = module_from_source(modules, name, source, length);
+    if (!program->module) {
+        return NULL;
+    }
+    program->used = true;
+    program->hash = hash;
+    program->length = length;
+    cache->next = (cache->next + 1) % SERVER_CACHE_SIZE;
+    return program->module;
+}
+
+static double elapsed_ms(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) * 1e3 +
+           (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// runs the program in slices so that it can be stopped once it has taken
+// longer than `timeout`
+static bool run_program(State *state, OpCodes opcodes, int timeout,
+                        struct timespec start) {
+    while (true) {
+        switch (interpret_slice(state, opcodes, SERVER_SLICE)) {
+        case RUN_DONE:
+            return true;
+        case RUN_ERROR:
+            return false;
+        default:
+            break;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_ms(start, now) >= timeout) {
+            fprintf(stderr,
+                    "bass: stopped the program after %dms\n"
+                    "help: the limit is set with `--timeout` on the server\n",
+                    timeout);
+            return false;
+        }
+    }
+}
+
+static bool run_request(int client, State *state, ProgramCache *cache,
+                        ModuleCache *modules, Options *options) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Request request;
+    if (!read_request(client, &request, options->root)) {
+        free(request.source);
+        free(request.name);
+        return false;
+    }
+    bool ok = false;
+    Module *module = get_program(cache, modules, request.name, request.source,
+                                 request.length);
+    Program program;
+    if (module && link_program(modules, module, &program)) {
+        state_reset(state);
+        for (int i = 0; i < REG_COUNT; i++) {
+            if (request.set[i]) {
+                state->registers[i] = wrap(state, request.registers[i]);
+            }
+        }
+        state->loops = &program.loops;
+        // same order as on the command line, mapped files are placed over
+        // the data of the program
+        state_load_image(state, program.data);
+        ok = true;
+        for (size_t i = 0; ok && i < options->mappings.size; i++) {
+            ok = state_map_file(state, options->mappings.data[i]);
+        }
+        ok = ok && run_program(state, program.opcodes, options->timeout, start);
+        state->loops = NULL;
+        program_free(&program);
+    }
+    if (!ok) {
+        fprintf(stderr, "bass: failed to run `%s`\n", request.name);
+    }
+    free(request.name);
+    return ok;
+}
+
+// stdout and stderr of the worker point into the client for the duration of
+// a request
+static void handle_client(int client, int saved_out, int saved_err,
+                          State *state, ProgramCache *cache,
+                          ModuleCache *modules, Options *options) {
+    int out[2], err[2];
+    if (pipe(out) < 0) {
+        close(client);
+        return;
+    }
+    if (pipe(err) < 0) {
+        close(out[0]);
+        close(out[1]);
+        close(client);
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    close(out[1]);
+    close(err[1]);
+
+    Relay relay = {client, out[0], err[0]};
+    pthread_t relay_thread;
+    bool relaying =
+        pthread_create(&relay_thread, NULL, relay_output, &relay) == 0;
+
+    // a client that stops sending in the middle of a request counts against
+    // its time limit as well
+    struct timeval timeout = {options->timeout / 1000,
+                              (options->timeout % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char status = run_request(client, state, cache, modules, options) ? 0 : 1;
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    if (relaying) {
+        pthread_join(relay_thread, NULL);
+    }
+    close(out[0]);
+    close(err[0]);
+    send_frame(client, FRAME_EXIT, &status, 1);
+    close(client);
+}
+
+static void worker_loop(int listener, Options *options) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    // output is streamed back to the client a line at a time
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    State state;
+    if (!state_init(&state)) {
+        fprintf(stderr, "bass: failed to allocate enough memory, exiting\n");
+        exit(1);
+    }
+    state.wide = options->wide;
+    // the files are mapped again for every request, this only makes a worker
+    // fail at startup when they cant be mapped at all
+    for (size_t i = 0; i < options->mappings.size; i++) {
+        if (!state_map_file(&state, options->mappings.data[i])) {
+            exit(1);
+        }
+    }
+    ProgramCache *cache = calloc(1, sizeof(ProgramCache));
+    assert(cache && "Catastrophic Failure: Allocation failed!");
+    // modules stay compiled across requests until their files change
+    ModuleCache modules = {.jobs = options->jobs, .root = options->root};
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+
+    while (true) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fprintf(stderr, "bass: failed to accept connection: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        handle_client(client, saved_out, saved_err, &state, cache, &modules,
+                      options);
+    }
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_server(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+static pid_t spawn_worker(int listener, Options *options) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        worker_loop(listener, options);
+    }
+    if (pid < 0) {
+        fprintf(stderr, "bass: failed to start worker: %s\n", strerror(errno));
+    }
+    return pid;
+}
+
+static bool socket_address(const char *socket_path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "bass: socket path `%s` is too long\n", socket_path);
+        return false;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return true;
+}
+
+// Forks a pool of worker processes that accept connections on the socket,
+// every worker owns a VM that is reset between requests and a cache of
+// parsed programs. The parent only restarts workers that die.
+bool serve(const char *socket_path, Options *options) {
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr)) {
+        return false;
+    }
+    const char *root = options->root ? options->root : ".";
+    char *canonical_root = realpath(root, NULL);
+    if (!canonical_root) {
+        fprintf(stderr, "bass: failed to open root directory `%s`: %s\n",
+                root, strerror(errno));
+        return false;
+    }
+    options->root = canonical_root;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "bass: failed to create socket: %s\n", strerror(errno));
+        free(canonical_root);
+        return false;
+    }
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 128) < 0) {
+        fprintf(stderr, "bass: failed to listen on `%s`: %s\n", socket_path,
+                strerror(errno));
+        close(listener);
+        free(canonical_root);
+        return false;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action = {0};
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int pool = (options->pool > 0) ? options->pool : 1;
+    pid_t *workers = calloc(pool, sizeof(pid_t));
+    assert(workers && "Catastrophic Failure: Allocation failed!");
+    for (int i = 0; i < pool; i++) {
+        workers[i] = spawn_worker(listener, options);
+    }
+    fprintf(stderr, "bass: serving files in `%s` on `%s` with %d workers\n",
+            options->root, socket_path, pool);
+
+    while (!stopping) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < pool && !stopping; i++) {
+            if (workers[i] == pid) {
+                fprintf(stderr, "bass: worker %d exited, restarting it\n",
+                        pid);
+                workers[i] = spawn_worker(listener, options);
+            }
+        }
+    }
+
+    for (int i = 0; i < pool; i++) {
+        if (workers[i] > 0) {
+            kill(workers[i], SIGTERM);
+            waitpid(workers[i], NULL, 0);
+        }
+    }
+    free(workers);
+    free(canonical_root);
+    close(listener);
+    unlink(socket_path);
+    return true;
+}
+
+static int connect_server(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "bass: failed to connect to `%s`: %s\n", socket_path,
+                strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// sends a request and waits for the exit frame, the output of the program is
+// written to stdout and stderr when `echo` is set
+static bool client_request(const char *socket_path, const char *request,
+                           size_t length, bool echo, int *status) {
+    int fd = connect_server(socket_path);
+    if (fd < 0) {
+        return false;
+    }
+    // the server stops reading a request that it rejects, the reason still
+    // comes back as a response
+    bool sent = write_all(fd, request, length);
+    int send_error = errno;
+
+    char *payload = NULL;
+    size_t capacity = 0;
+    while (true) {
+        char header[1 + sizeof(uint32_t)];
+        uint32_t size;
+        if (!read_all(fd, header, sizeof(header))) {
+            if (sent) {
+                fprintf(stderr, "bass: server closed the connection\n");
+            } else {
+                fprintf(stderr, "bass: failed to send request: %s\n",
+                        strerror(send_error));
+            }
+            break;
+        }
+        memcpy(&size, &header[1], sizeof(size));
+        if (size > capacity) {
+            capacity = size;
+            payload = realloc(payload, capacity);
+            assert(payload && "Catastrophic Failure: Allocation failed!");
+        }
+        if (!read_all(fd, payload, size)) {
+            fprintf(stderr, "bass: server closed the connection\n");
+            break;
+        }
+        if (header[0] == FRAME_EXIT) {
+            *status = (size > 0) ? payload[0] : 1;
+            free(payload);
+            close(fd);
+            return true;
+        }
+        // frames are written as they come so that the output keeps streaming
+        // when stdout is a pipe
+        if (echo) {
+            FILE *stream = (header[0] == FRAME_STDERR) ? stderr : stdout;
+            fwrite(payload, 1, size, stream);
+            fflush(stream);
+        }
+    }
+    free(payload);
+    close(fd);
+    return false;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report_latencies(const char *name, double *times, int count) {
+    qsort(times, count, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        total += times[i];
+    }
+    fprintf(stderr,
+            "  %-8s mean %.3fms  p50 %.3fms  p99 %.3fms  max %.3fms\n", name,
+            total / count, times[count / 2], times[(count * 99) / 100],
+            times[count - 1]);
+}
+
+// compares running `path` with a fresh `bass` process against a round-trip
+// through the server
+static int run_benchmark(const char *socket_path, const char *path,
+                         const char *request, size_t length, int runs) {
+    double *daemon = calloc(runs, sizeof(double));
+    double *cold = calloc(runs, sizeof(double));
+    assert(daemon && cold && "Catastrophic Failure: Allocation failed!");
+
+    int devnull = open("/dev/null", O_WRONLY);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, devnull, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, devnull, STDERR_FILENO);
+    char *argv[] = {"bass", (char *)path, NULL};
+
+    int result = 0;
+    for (int i = 0; i < runs; i++) {
+        struct timespec start, end;
+        int status;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!client_request(socket_path, request, length, false, &status)) {
+            result = 1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        daemon[i] = elapsed_ms(start, end);
+
+        pid_t pid;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (posix_spawn(&pid, "/proc/self/exe", &actions, NULL, argv,
+                        environ) != 0) {
+            fprintf(stderr, "bass: failed to start `bass`\n");
+            result = 1;
+            break;
+        }
+        waitpid(pid, NULL, 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cold[i] = elapsed_ms(start, end);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(devnull);
+
+    if (result == 0) {
+        fprintf(stderr, "bass: latency of `%s` over %d runs:\n", path, runs);
+        report_latencies("cold", cold, runs);
+        report_latencies("daemon", daemon, runs);
+    }
+    free(daemon);
+    free(cold);
+    return result;
+}
+
+int run_client(const char *socket_path, int argc, char *argv[]) {
+    Buffer request = {0};
+    const char *program = NULL;
+    int bench_runs = 0;
+    char line[PATH_MAX + 16];
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--reg") == 0 && i + 1 < argc) {
+            int reg;
+            long long value;
+            if (sscanf(argv[++i], "%d=%lld", &reg, &value) != 2) {
+                fprintf(stderr, "bass: invalid register `%s`\n"
+                                "help: expected N=VALUE\n", argv[i]);
+                return 1;
+            }
+            int n = snprintf(line, sizeof(line), "reg %d %lld\n", reg, value);
+            buffer_append(&request, line, n);
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_runs = atoi(argv[++i]);
+        } else if (!program) {
+            program = argv[i];
+        } else {
+            fprintf(stderr, "bass: unexpected argument `%s`\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!program) {
+        fprintf(stderr, "bass: no input file provided to client\n");
+        return 1;
+    }
+
+    // the server may have a different working directory so paths are sent as
+    // absolute paths, `-` sends the source read from stdin instead
+    if (strcmp(program, "-") == 0) {
+        Buffer source = {0};
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            buffer_append(&source, chunk, n);
+        }
+        int header = snprintf(line, sizeof(line), "source %zu\n", source.size);
+        buffer_append(&request, line, header);
+        buffer_append(&request, source.data, source.size);
+        free(source.data);
+    } else {
+        char path[PATH_MAX];
+        if (!realpath(program, path)) {
+            fprintf(stderr, "bass: failed to open source file `%s`: %s\n",
+                    program, strerror(errno));
+            return 1;
+        }
+        int n = snprintf(line, sizeof(line), "path %s\n", path);
+        buffer_append(&request, line, n);
+    }
+
+    int status = 1;
+    if (bench_runs > 0) {
+        if (strcmp(program, "-") == 0) {
+            fprintf(stderr, "bass: benchmarking needs a source file\n");
+        } else {
+            status = run_benchmark(socket_path, program, request.data,
+                                   request.size, bench_runs);
+        }
+    } else if (!client_request(socket_path, request.data, request.size, true,
+                               &status)) {
+        status = 1;
+    }
+    free(request.data);
+    return status;
+}
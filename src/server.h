@@ -0,0 +1,33 @@
+#ifndef BASS_SERVER_H
+#define BASS_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "options.h"
+
+// Requests are lines of text terminated by the program to run:
+//
+//     reg <N> <VALUE>\n       (optional, sets the initial value of rN)
+//     path <PATH>\n           (run the file at PATH, or)
+//     source <LENGTH>\n...    (run the LENGTH bytes of source that follow)
+//
+// The response is a sequence of frames made out of a type byte and a 32-bit
+// length in host byte order followed by the payload.
+#define FRAME_STDOUT 'o'
+#define FRAME_STDERR 'e'
+#define FRAME_EXIT 'x' // payload is a single byte: 0 on success, 1 on failure
+
+#define SERVER_CACHE_SIZE 64 // parsed programs cached by each worker
+#define SERVER_MAX_SOURCE (16 << 20) // largest program that can be sent
+#define SERVER_TIMEOUT 10000 // default for `--timeout`, in milliseconds
+#define SERVER_SLICE 100000 // opcodes run between two checks of the timeout
+
+// Serves requests on a pool of worker processes until interrupted. Programs
+// can only read files inside of `options->root` (the current directory by
+// default) and are stopped once they have run for `options->timeout`.
+bool serve(const char *socket_path, Options *options);
+// `argc` and `argv` are the client arguments following the socket path
+int run_client(const char *socket_path, int argc, char *argv[]);
+
+#endif
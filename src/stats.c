@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "stats.h"
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1; // count the parser threads as well
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#define CACHE_READ_MISS(cache)                                                 \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                            \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static void open_counters(Stats *stats) {
+    stats->fds[STAT_CYCLES] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    stats->fds[STAT_INSTRUCTIONS] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    stats->fds[STAT_BRANCH_MISSES] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    stats->fds[STAT_L1D_MISSES] = open_counter(
+        PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D));
+    stats->fds[STAT_LLC_MISSES] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+#else
+static void open_counters(Stats *stats) {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        stats->fds[i] = -1;
+    }
+}
+#endif
+
+static inline double timeval_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void stats_start(Stats *stats, const char *name) {
+    memset(stats, 0, sizeof(*stats));
+    stats->name = name;
+    open_counters(stats);
+    getrusage(RUSAGE_SELF, &stats->usage_start);
+    clock_gettime(CLOCK_MONOTONIC, &stats->start);
+#ifdef __linux__
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (stats->fds[i] >= 0) {
+            ioctl(stats->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(stats->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void stats_stop(Stats *stats) {
+#ifdef __linux__
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (stats->fds[i] >= 0) {
+            ioctl(stats->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (stats->fds[i] < 0) {
+            continue;
+        }
+        if (read(stats->fds[i], &stats->values[i], sizeof(uint64_t)) !=
+            sizeof(uint64_t)) {
+            stats->values[i] = 0;
+        }
+        close(stats->fds[i]);
+    }
+
+    stats->wall = (end.tv_sec - stats->start.tv_sec) +
+                  (end.tv_nsec - stats->start.tv_nsec) / 1e9;
+    stats->user = timeval_seconds(usage.ru_utime) -
+                  timeval_seconds(stats->usage_start.ru_utime);
+    stats->sys = timeval_seconds(usage.ru_stime) -
+                 timeval_seconds(stats->usage_start.ru_stime);
+    stats->faults = (usage.ru_minflt - stats->usage_start.ru_minflt) +
+                    (usage.ru_majflt - stats->usage_start.ru_majflt);
+    stats->ctx_switches = (usage.ru_nvcsw - stats->usage_start.ru_nvcsw) +
+                          (usage.ru_nivcsw - stats->usage_start.ru_nivcsw);
+}
+
+void stats_cancel(Stats *stats) {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (stats->fds[i] >= 0) {
+            close(stats->fds[i]);
+            stats->fds[i] = -1;
+        }
+    }
+}
+
+#define HAS_STAT(stats, type) ((stats)->fds[(type)] >= 0)
+
+void stats_report(Stats *stats, size_t retired) {
+    fprintf(stderr, "bass: stats for %s:\n", stats->name);
+    fprintf(stderr, "  %-28s %.6fs\n", "wall time", stats->wall);
+    fprintf(stderr, "  %-28s %.6fs\n", "user time", stats->user);
+    fprintf(stderr, "  %-28s %.6fs\n", "system time", stats->sys);
+    fprintf(stderr, "  %-28s %ld\n", "page faults", stats->faults);
+    fprintf(stderr, "  %-28s %ld\n", "context switches", stats->ctx_switches);
+
+    bool any = false;
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (HAS_STAT(stats, i)) {
+            any = true;
+            fprintf(stderr, "  %-28s %llu\n", STAT_STRING[i],
+                    (unsigned long long)stats->values[i]);
+        }
+    }
+    if (!any) {
+        fprintf(stderr, "  (hardware counters unavailable, check "
+                        "/proc/sys/kernel/perf_event_paranoid)\n");
+    }
+
+    if (retired) {
+        fprintf(stderr, "  %-28s %zu\n", "bass instructions", retired);
+        fprintf(stderr, "  %-28s %.2f\n", "ns per bass instruction",
+                stats->wall * 1e9 / retired);
+    }
+    uint64_t cycles = stats->values[STAT_CYCLES];
+    uint64_t instructions = stats->values[STAT_INSTRUCTIONS];
+    if (HAS_STAT(stats, STAT_CYCLES) && HAS_STAT(stats, STAT_INSTRUCTIONS) &&
+        cycles) {
+        fprintf(stderr, "  %-28s %.2f\n", "IPC", (double)instructions / cycles);
+    }
+    if (retired && HAS_STAT(stats, STAT_CYCLES)) {
+        fprintf(stderr, "  %-28s %.2f\n", "cycles per bass instr",
+                (double)cycles / retired);
+    }
+    if (retired && HAS_STAT(stats, STAT_INSTRUCTIONS)) {
+        fprintf(stderr, "  %-28s %.2f\n", "instrs per bass instr",
+                (double)instructions / retired);
+    }
+    if (retired && HAS_STAT(stats, STAT_BRANCH_MISSES)) {
+        fprintf(stderr, "  %-28s %.4f\n", "branch misses per bass instr",
+                (double)stats->values[STAT_BRANCH_MISSES] / retired);
+    }
+}
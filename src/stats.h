@@ -0,0 +1,49 @@
+#ifndef BASS_STATS_H
+#define BASS_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <time.h>
+
+typedef enum {
+    STAT_CYCLES,
+    STAT_INSTRUCTIONS,
+    STAT_BRANCH_MISSES,
+    STAT_L1D_MISSES,
+    STAT_LLC_MISSES,
+
+    STAT_COUNT
+} StatType;
+
+static const char *const STAT_STRING[STAT_COUNT] = {
+    [STAT_CYCLES] = "cycles",
+    [STAT_INSTRUCTIONS] = "instructions",
+    [STAT_BRANCH_MISSES] = "branch misses",
+    [STAT_L1D_MISSES] = "L1d misses",
+    [STAT_LLC_MISSES] = "LLC misses",
+};
+
+// hardware counters (when available) plus wall time and rusage for a single
+// phase such as parsing or interpreting
+typedef struct {
+    const char *name;
+    int fds[STAT_COUNT]; // -1 when the counter couldnt be opened
+    uint64_t values[STAT_COUNT];
+    struct timespec start;
+    struct rusage usage_start;
+    double wall;      // seconds
+    double user, sys; // seconds
+    long faults;      // minor + major page faults
+    long ctx_switches;
+} Stats;
+
+void stats_start(Stats *stats, const char *name);
+void stats_stop(Stats *stats);
+// closes the counters of a phase that failed before it could be stopped
+void stats_cancel(Stats *stats);
+// `retired` is the number of bass instructions executed during the phase,
+// pass 0 when it doesnt apply
+void stats_report(Stats *stats, size_t retired);
+
+#endif
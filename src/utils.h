@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -17,6 +18,85 @@ do {                                                                         \
     (da)->data[(da)->size++] = item;                                           \
 } while (0)
 
+// Bump allocator made out of a linked list of regions. Everything allocated
+// from it is freed at once with `arena_free`
+typedef struct Region {
+    struct Region *next;
+    size_t size;
+    size_t capacity;
+    char data[];
+} Region;
+
+typedef struct {
+    Region *begin;
+    Region *end;
+} Arena;
+
+#define ARENA_REGION_DEFAULT_CAPACITY (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+static inline void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (!arena->end || arena->end->capacity - arena->end->size < size) {
+        size_t capacity = (size > ARENA_REGION_DEFAULT_CAPACITY)
+                              ? size
+                              : ARENA_REGION_DEFAULT_CAPACITY;
+        Region *region = malloc(sizeof(Region) + capacity);
+        assert(region && "Catastrophic Failure: Allocation failed!");
+        region->next = NULL;
+        region->size = 0;
+        region->capacity = capacity;
+        if (arena->end) {
+            arena->end->next = region;
+        } else {
+            arena->begin = region;
+        }
+        arena->end = region;
+    }
+    void *ptr = &arena->end->data[arena->end->size];
+    arena->end->size += size;
+    return ptr;
+}
+
+static inline void arena_free(Arena *arena) {
+    Region *region = arena->begin;
+    while (region) {
+        Region *next = region->next;
+        free(region);
+        region = next;
+    }
+    arena->begin = NULL;
+    arena->end = NULL;
+}
+
+// sets the capacity of an empty dynamic array, allocating from an arena
+#define arena_dyn_reserve(arena, da, cap)                                      \
+do {                                                                           \
+    (da)->capacity = (cap);                                                    \
+    (da)->data = arena_alloc((arena), (da)->capacity * sizeof(*(da)->data));   \
+} while (0)
+
+// makes room for at least one more item in a dynamic array backed by an
+// arena, the old storage is simply abandoned when the array grows
+#define arena_dyn_grow(arena, da)                                              \
+do {                                                                           \
+    if ((da)->size == (da)->capacity) {                                        \
+        size_t item_size = sizeof(*(da)->data);                                \
+        size_t new_capacity = ((da)->capacity <= 0) ? 1 : (da)->capacity * 2;  \
+        void *new_data = arena_alloc((arena), new_capacity * item_size);       \
+        if ((da)->size) memcpy(new_data, (da)->data, (da)->size * item_size);  \
+        (da)->data = new_data;                                                 \
+        (da)->capacity = new_capacity;                                         \
+    }                                                                          \
+} while (0)
+
+// same as `dyn_append` but the storage comes from an arena
+#define arena_dyn_append(arena, da, item)                                      \
+do {                                                                           \
+    arena_dyn_grow((arena), (da));                                             \
+    (da)->data[(da)->size++] = item;                                           \
+} while (0)
+
 #define MODULO(a, b) (((a) % (b)) + (b)) % (b);
 
 typedef struct {
@@ -51,6 +131,24 @@ static inline bool string_view_eq(StringView a, StringView b) {
     return (strncmp(a.data, b.data, a.length) == 0);
 }
 
+// FNV-1a
+static inline uint64_t string_view_hash(StringView sv) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sv.length; i++) {
+        hash ^= (unsigned char)sv.data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// checks that the canonical `path` is the directory `root` or inside of it
+static inline bool path_inside(const char *root, const char *path) {
+    size_t length = strlen(root);
+    return strncmp(path, root, length) == 0 &&
+           (path[length] == '/' || path[length] == '\0' ||
+            (length > 0 && root[length - 1] == '/'));
+}
+
 static inline bool read_to_string(const char *filepath, StringView *sv) {
     FILE *file = fopen(filepath, "r");
     if (!file) {
@@ -75,7 +173,11 @@ static inline bool read_to_string(const char *filepath, StringView *sv) {
     fclose(file);
 
     data[size] = 0;
-    *sv = (StringView){data, size - 1};
+    // the last line is parsed the same with or without its newline
+    if (size > 0 && data[size - 1] == '\n') {
+        size--;
+    }
+    *sv = (StringView){data, size};
     return true;
 }
 
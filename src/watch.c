@@ -0,0 +1,379 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interpreter.h"
+#include "linker.h"
+#include "options.h"
+#include "parser.h"
+#include "utils.h"
+#include "watch.h"
+
+typedef struct {
+    int wd;     // watch of the directory of the file
+    char *name; // name of the file in that directory
+} WatchedFile;
+
+typedef struct {
+    WatchedFile *data;
+    size_t size;
+    size_t capacity;
+} WatchedFiles;
+
+// The main file comes first, followed by the modules it imported so far.
+// Editors often write a new file and move it over the old one, so the
+// directories are watched for the files being written or moved into place.
+typedef struct {
+    int fd;
+    WatchedFiles files;
+} Watcher;
+
+static bool watcher_add(Watcher *watcher, const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
+    assert(dir && "Catastrophic Failure: Allocation failed!");
+    const char *name = slash ? slash + 1 : path;
+    int wd = inotify_add_watch(watcher->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    free(dir);
+    if (wd < 0) {
+        fprintf(stderr, "bass: failed to watch `%s`: %s\n", path,
+                strerror(errno));
+        return false;
+    }
+    for (size_t i = 0; i < watcher->files.size; i++) {
+        WatchedFile file = watcher->files.data[i];
+        if (file.wd == wd && strcmp(file.name, name) == 0) {
+            return true;
+        }
+    }
+    WatchedFile file = {wd, strdup(name)};
+    assert(file.name && "Catastrophic Failure: Allocation failed!");
+    dyn_append(&watcher->files, file);
+    return true;
+}
+
+static bool watcher_init(Watcher *watcher, const char *path) {
+    *watcher = (Watcher){0};
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        fprintf(stderr, "bass: failed to watch `%s`: %s\n", path,
+                strerror(errno));
+        return false;
+    }
+    return watcher_add(watcher, path);
+}
+
+static void watcher_free(Watcher *watcher) {
+    close(watcher->fd);
+    for (size_t i = 0; i < watcher->files.size; i++) {
+        free(watcher->files.data[i].name);
+    }
+    free(watcher->files.data);
+}
+
+// Reads every pending event (waiting for some when `block` is set), sets
+// `changed` if any of them were about the main file and `imported` if they
+// were about one of its modules.
+static bool watcher_read(Watcher *watcher, bool block, bool *changed,
+                         bool *imported) {
+    char buffer[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    *changed = false;
+    *imported = false;
+    for (;;) {
+        ssize_t length = read(watcher->fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0 && errno != EAGAIN) {
+            fprintf(stderr, "bass: failed to read file events: %s\n",
+                    strerror(errno));
+            return false;
+        }
+        if (length < 0) {
+            if (!block || *changed || *imported) {
+                return true;
+            }
+            struct pollfd pfd = {watcher->fd, POLLIN, 0};
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        for (char *cur = buffer; cur < buffer + length;) {
+            struct inotify_event *event = (struct inotify_event *)cur;
+            for (size_t i = 0; event->len && i < watcher->files.size; i++) {
+                WatchedFile file = watcher->files.data[i];
+                if (file.wd == event->wd &&
+                    strcmp(event->name, file.name) == 0) {
+                    *(i == 0 ? changed : imported) = true;
+                }
+            }
+            cur += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+typedef struct {
+    const char *path;
+    Options *options;
+    Watcher watcher;
+    ModuleCache modules;
+    Module *main;    // NULL until the file compiles
+    Program program; // empty until it links
+    State state;
+    bool running;
+} Session;
+
+// a fresh VM with the data of the program and the mapped files in memory
+static bool start(Session *session) {
+    State *state = &session->state;
+    if (!state_init(state)) {
+        fprintf(stderr, "bass: failed to allocate enough memory\n");
+        return false;
+    }
+    state->wide = session->options->wide;
+    state->loops = &session->program.loops;
+    state_load_image(state, session->program.data);
+    Mappings mappings = session->options->mappings;
+    for (size_t i = 0; i < mappings.size; i++) {
+        if (!state_map_file(state, mappings.data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Finds the label closest before `pc`, returns false if there is none and
+// the start of the program has to be used instead.
+static bool find_anchor(Labels labels, size_t pc, Label *anchor) {
+    bool found = false;
+    for (size_t i = 0; i < labels.size; i++) {
+        Label label = labels.data[i];
+        if (label.index <= pc && (!found || label.index > anchor->index)) {
+            *anchor = label;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// finds a label that is defined exactly once
+static bool find_unique(Labels labels, StringView name, Label *result) {
+    size_t count = 0;
+    for (size_t i = 0; i < labels.size; i++) {
+        if (string_view_eq(labels.data[i].name, name)) {
+            *result = labels.data[i];
+            count++;
+        }
+    }
+    return count == 1;
+}
+
+// Where the VM is in the old program, through the closest label before the
+// current opcode. It has to be taken before the edit is linked, as linking
+// compiles changed imports again and frees the sources that the labels and
+// opcodes of the old program point into.
+typedef struct {
+    char *anchor;  // NULL when there is no label before the opcode
+    OpType *ops;   // opcodes from the label up to the current one
+    size_t offset; // of the current opcode from the label
+} Position;
+
+// the label has to be defined once, otherwise it isnt clear where to continue
+static bool save_position(Program *old, size_t pc, Position *position) {
+    *position = (Position){0};
+    size_t from = 0;
+    Label anchor = {0}, label;
+    if (find_anchor(old->labels, pc, &anchor)) {
+        if (!find_unique(old->labels, anchor.name, &label)) {
+            return false;
+        }
+        position->anchor = string_view_to_cstring(anchor.name);
+        from = anchor.index;
+    }
+    position->offset = pc - from;
+    position->ops = malloc((position->offset + 1) * sizeof(OpType));
+    assert(position->ops && "Catastrophic Failure: Allocation failed!");
+    for (size_t i = 0; i < position->offset; i++) {
+        position->ops[i] = old->opcodes.data[from + i].op;
+    }
+    return true;
+}
+
+static void position_free(Position *position) {
+    free(position->anchor);
+    free(position->ops);
+    *position = (Position){0};
+}
+
+// Maps a position of the old program into the new one. The label has to be
+// defined once in the new program as well and followed by the same opcodes.
+static bool map_pc(Position *position, Program *new, size_t *result) {
+    size_t to = 0;
+    Label label;
+    if (position->anchor) {
+        StringView name = {position->anchor, strlen(position->anchor)};
+        if (!find_unique(new->labels, name, &label)) {
+            return false;
+        }
+        to = label.index;
+    }
+    if (to + position->offset > new->opcodes.size) {
+        return false;
+    }
+    for (size_t i = 0; i < position->offset; i++) {
+        if (position->ops[i] != new->opcodes.data[to + i].op) {
+            return false;
+        }
+    }
+    *result = to + position->offset;
+    return true;
+}
+
+// Watches the files imported by `module` and by every module compiled so far,
+// including files that didnt compile so that fixing them is noticed as well.
+static void watch_imports(Session *session, Module *module) {
+    ModuleList *modules = &session->modules.modules;
+    for (size_t i = 0; i <= modules->size; i++) {
+        Module *importer = (i < modules->size) ? modules->data[i] : module;
+        Imports imports = importer->parser.imports;
+        for (size_t j = 0; j < imports.size; j++) {
+            char *path = module_import_path(importer, imports.data[j].path);
+            watcher_add(&session->watcher, path);
+            free(path);
+        }
+    }
+}
+
+static double elapsed_ms(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) * 1e3 +
+           (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Compiles the edited file and swaps it into the VM at its current opcode,
+// or restarts the VM when the opcode cant be mapped into the new program. A
+// file that doesnt compile leaves the old program running. `imported` is set
+// when one of its modules changed, which are compiled again while linking.
+static void reload(Session *session, bool imported) {
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    StringView source;
+    if (!read_to_string(session->path, &source)) {
+        return;
+    }
+    Module *main = session->main;
+    // editors tend to write a file several times when saving it
+    if (main && session->running && !imported &&
+        main->parser.source.length == source.length &&
+        memcmp(main->parser.source.data, source.data, source.length) == 0) {
+        free((char *)source.data);
+        return;
+    }
+
+    fflush(stdout);
+    Position position = {0};
+    bool positioned = session->running &&
+                      save_position(&session->program, session->state.reg_pc,
+                                    &position);
+    bool spliced = false;
+    ModuleCache *modules = &session->modules;
+    Module *edited =
+        main ? module_edit(modules, main, (char *)source.data, source.length,
+                           &spliced)
+             : module_from_source(modules, session->path, (char *)source.data,
+                                  source.length);
+    Program program;
+    bool linked = edited && link_program(&session->modules, edited, &program);
+    if (edited) {
+        watch_imports(session, edited);
+    }
+    if (edited && !linked) {
+        module_free(edited);
+        edited = NULL;
+        // imported modules that changed on disk were compiled again while
+        // linking and the old program might point into their sources
+        if (main && main->parser.imports.size) {
+            session->running = false;
+        }
+    }
+    if (!edited) {
+        fprintf(stderr, "bass: `%s` didnt compile, %s\n", session->path,
+                session->running ? "keeping the old program"
+                                 : "waiting for changes");
+        position_free(&position);
+        return;
+    }
+
+    size_t pc = 0;
+    bool was_running = session->running;
+    bool mapped = positioned && map_pc(&position, &program, &pc);
+    position_free(&position);
+    program_free(&session->program);
+    if (main) {
+        module_free(main);
+    }
+    session->main = edited;
+    session->program = program;
+    if (mapped) {
+        session->state.reg_pc = pc;
+        session->state.loops = &session->program.loops;
+    } else {
+        state_free(&session->state);
+        session->running = start(session);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const char *parsed = spliced ? "edited lines parsed" : "whole file parsed";
+    if (mapped) {
+        fprintf(stderr, "bass: swapped in `%s` at opcode %zu (%.2fms, %s)\n",
+                session->path, pc, elapsed_ms(begin, end), parsed);
+    } else if (main) {
+        fprintf(stderr, "bass: restarted `%s`%s (%.2fms, %s)\n",
+                session->path,
+                was_running ? " as the edit moved the current opcode" : "",
+                elapsed_ms(begin, end), parsed);
+    }
+}
+
+bool watch(const char *path, Options *options) {
+    Session session = {.path = path, .options = options};
+    if (!watcher_init(&session.watcher, path)) {
+        return false;
+    }
+    session.modules.jobs = options->jobs;
+    // a file that doesnt compile yet is simply waited on
+    reload(&session, false);
+
+    for (;;) {
+        if (session.running) {
+            RunStatus status = interpret_slice(
+                &session.state, session.program.opcodes, WATCH_QUANTUM);
+            if (status == RUN_DONE || status == RUN_ERROR) {
+                fflush(stdout);
+                fprintf(stderr, "bass: `%s` %s, waiting for changes\n", path,
+                        (status == RUN_DONE) ? "finished" : "failed");
+                session.running = false;
+            }
+        }
+        bool changed, imported;
+        if (!watcher_read(&session.watcher, !session.running, &changed,
+                          &imported)) {
+            break;
+        }
+        if (changed || imported) {
+            reload(&session, imported);
+        }
+    }
+    watcher_free(&session.watcher);
+    state_free(&session.state);
+    program_free(&session.program);
+    if (session.main) {
+        module_free(session.main);
+    }
+    module_cache_free(&session.modules);
+    return false;
+}
@@ -0,0 +1,16 @@
+#ifndef BASS_WATCH_H
+#define BASS_WATCH_H
+
+#include <stdbool.h>
+
+#include "options.h"
+
+// opcodes run between two checks for changes to the watched file
+#define WATCH_QUANTUM 100000
+
+// Runs the program at `path` and swaps every edit of it into the running VM,
+// keeping its registers, stack and memory. Runs until interrupted and only
+// returns on errors.
+bool watch(const char *path, Options *options);
+
+#endif
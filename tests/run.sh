@@ -0,0 +1,527 @@
+#!/bin/sh
+# Regression checks for bass. Features are checked against a run of the same
+# program without them (or against known output), so that they keep giving
+# the same results as the plain interpreter.
+#
+# usage: tests/run.sh [BASS]   (BASS defaults to ./bass)
+
+bass=$(realpath "${1:-./bass}")
+root=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/bass-tests.XXXXXX")
+trap 'rm -rf "$tmp"' EXIT
+passed=0
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=$((failed + 1))
+}
+
+# run NAME ARGS...: runs bass with ARGS, its output and exit status end up in
+# $tmp/NAME.out, $tmp/NAME.err and $tmp/NAME.status
+run() {
+    name=$1
+    shift
+    "$bass" "$@" > "$tmp/$name.out" 2> "$tmp/$name.err"
+    echo $? > "$tmp/$name.status"
+}
+
+# same A B: runs A and B gave the same output and status
+same() {
+    if cmp -s "$tmp/$1.out" "$tmp/$2.out" &&
+        cmp -s "$tmp/$1.status" "$tmp/$2.status"; then
+        passed=$((passed + 1))
+    else
+        fail "\`$1\` and \`$2\` differ"
+        diff "$tmp/$1.out" "$tmp/$2.out" | head -n 10
+    fi
+}
+
+# same_errors A B: runs A and B failed with the same errors
+same_errors() {
+    if [ "$(cat "$tmp/$1.status")" != 0 ] &&
+        cmp -s "$tmp/$1.err" "$tmp/$2.err" &&
+        cmp -s "$tmp/$1.status" "$tmp/$2.status"; then
+        passed=$((passed + 1))
+    else
+        fail "\`$1\` and \`$2\` dont fail the same way"
+        diff "$tmp/$1.err" "$tmp/$2.err" | head -n 10
+    fi
+}
+
+# expect NAME OUTPUT: run NAME succeeded with OUTPUT
+expect() {
+    printf '%s\n' "$2" > "$tmp/$1.expected"
+    if [ "$(cat "$tmp/$1.status")" = 0 ] &&
+        cmp -s "$tmp/$1.expected" "$tmp/$1.out"; then
+        passed=$((passed + 1))
+    else
+        fail "\`$1\` gave unexpected output"
+        diff "$tmp/$1.expected" "$tmp/$1.out" | head -n 10
+        head -n 5 "$tmp/$1.err"
+    fi
+}
+
+# fails NAME MESSAGE: run NAME failed with MESSAGE on stderr
+fails() {
+    if [ "$(cat "$tmp/$1.status")" != 0 ] &&
+        grep -qF -- "$2" "$tmp/$1.err"; then
+        passed=$((passed + 1))
+    else
+        fail "\`$1\` didnt fail with \`$2\`"
+        head -n 5 "$tmp/$1.err"
+    fi
+}
+
+# logged NAME MESSAGE: run NAME printed MESSAGE on stderr
+logged() {
+    if grep -qF -- "$2" "$tmp/$1.err"; then
+        passed=$((passed + 1))
+    else
+        fail "\`$1\` didnt print \`$2\`"
+        head -n 5 "$tmp/$1.err"
+    fi
+}
+
+# start_watch NAME FILE: runs `bass --watch FILE` in the background, like run
+# but without a status as it only stops when killed with stop_watch
+start_watch() {
+    "$bass" --watch "$2" > "$tmp/$1.out" 2> "$tmp/$1.err" &
+    watcher=$!
+    sleep 0.5
+}
+
+stop_watch() {
+    kill "$watcher"
+    wait "$watcher" 2> /dev/null
+}
+
+# the examples, which every other check builds on
+for example in "$root"/examples/*.bass; do
+    name=example_$(basename "$example" .bass)
+    run "$name" "$example"
+    if [ "$(cat "$tmp/$name.status")" = 0 ]; then
+        passed=$((passed + 1))
+    else
+        fail "\`$example\` failed"
+        head -n 5 "$tmp/$name.err"
+    fi
+done
+
+# host files mapped into memory
+printf 'ABCD' > "$tmp/map.bin"
+printf 'println @4096\n' > "$tmp/map_read.bass"
+run map_read --map "$tmp/map.bin@4096" "$tmp/map_read.bass"
+expect map_read 1145258561
+printf 'move @4096 #1\n' > "$tmp/map_write.bass"
+run map_write_ro --map "$tmp/map.bin@4096" "$tmp/map_write.bass"
+fails map_write_ro "read-only mapping"
+printf 'move @4096 #0x44434241\n' > "$tmp/map_write.bass"
+printf 'XXXX' > "$tmp/map_rw.bin"
+run map_write_rw --map "$tmp/map_rw.bin@4096:rw" "$tmp/map_write.bass"
+printf 'ABCD' > "$tmp/map_write_rw.expected"
+if cmp -s "$tmp/map_rw.bin" "$tmp/map_write_rw.expected"; then
+    passed=$((passed + 1))
+else
+    fail "\`rw\` mapping wasnt written back"
+fi
+
+# number literals, which are converted without strtol when possible
+printf 'println #0x10\nprintln #-42\nprintln #010\nprintln #0\n' \
+    > "$tmp/numbers.bass"
+run numbers "$tmp/numbers.bass"
+expect numbers "16
+-42
+8
+0"
+printf 'println #99999999999999999999\n' > "$tmp/number_range.bass"
+run number_range "$tmp/number_range.bass"
+fails number_range "invalid number \`99999999999999999999\` at: 1:10"
+printf 'add r0 r0 #12ab\n' > "$tmp/number_suffix.bass"
+run number_suffix "$tmp/number_suffix.bass"
+fails number_suffix "invalid number \`12ab\` at: 1:12"
+
+# every block of the benchmark program is a label and six opcodes
+"$root/bench/generate.sh" 2 > "$tmp/generated.bass"
+run generated -d "$tmp/generated.bass"
+if [ "$(grep -c '^OpCode' "$tmp/generated.out")" = 13 ] &&
+    [ "$(grep -c '^Label:' "$tmp/generated.out")" = 3 ]; then
+    passed=$((passed + 1))
+else
+    fail "generated program didnt parse into 13 opcodes and 3 labels"
+fi
+
+# parsing in chunks on several threads, large enough for four chunks
+{
+    echo ".equ FIRST 4"
+    "$root/bench/generate.sh" 7000
+    echo "println #FIRST"
+} > "$tmp/chunks.bass"
+run chunks_serial --jobs 1 -d "$tmp/chunks.bass"
+run chunks_parallel --jobs 4 -d "$tmp/chunks.bass"
+same chunks_serial chunks_parallel
+{
+    echo ".equ FIRST 4"
+    "$root/bench/generate.sh" 7000
+    echo ".equ FIRST 5"
+} > "$tmp/chunks_redefined.bass"
+run chunks_redefined_serial --jobs 1 "$tmp/chunks_redefined.bass"
+run chunks_redefined_parallel --jobs 4 "$tmp/chunks_redefined.bass"
+fails chunks_redefined_serial "constant \`FIRST\` redefined"
+same_errors chunks_redefined_serial chunks_redefined_parallel
+{
+    "$root/bench/generate.sh" 3000
+    echo "bogus r0"
+    "$root/bench/generate.sh" 3000
+    echo "move r9 #0"
+} > "$tmp/chunks_error.bass"
+run chunks_error_serial --jobs 1 "$tmp/chunks_error.bass"
+run chunks_error_parallel --jobs 4 "$tmp/chunks_error.bass"
+fails chunks_error_serial "invalid opcode \`bogus\`"
+same_errors chunks_error_serial chunks_error_parallel
+
+# counters dont change what a program prints
+for example in fact data; do
+    run "stats_$example" --stats "$root/examples/$example.bass"
+    same "example_$example" "stats_$example"
+done
+printf 'jump nowhere\n' > "$tmp/stats_error.bass"
+run stats_error --stats "$tmp/stats_error.bass"
+fails stats_error "couldnt find label: \`nowhere\`"
+
+# sized memory accesses and 64-bit registers
+cat > "$tmp/widths.bass" <<'BASS'
+storeb #100 #0x1ff
+loadb r0 #100
+println r0
+storeh #200 #0x12345
+loadh r0 #200
+println r0
+storew #401 #-5
+loadw r0 #401
+println r0
+storeq #500 #0x123456789
+loadq r0 #500
+println r0
+move r0 #0x7fffffff
+add r0 r0 #1
+println r0
+BASS
+run widths "$tmp/widths.bass"
+expect widths "255
+9029
+-5
+591751049
+-2147483648"
+run widths_wide --wide "$tmp/widths.bass"
+expect widths_wide "255
+9029
+-5
+4886718345
+2147483648"
+printf 'move r0 #-9223372036854775808\ndiv r1 r0 #-1\nmod r2 r0 #-1
+println r1\nprintln r2\n' > "$tmp/div_min.bass"
+run div_min --wide "$tmp/div_min.bass"
+expect div_min "-9223372036854775808
+0"
+printf 'div r0 #1 #0\n' > "$tmp/div_zero.bass"
+run div_zero "$tmp/div_zero.bass"
+fails div_zero "division by 0"
+
+# start_server ARGS...: starts a daemon with ARGS in the background and waits
+# until it listens on $socket
+start_server() {
+    "$bass" "$@" 2> "$tmp/server.err" &
+    server=$!
+    i=0
+    while [ ! -S "$socket" ] && [ "$i" -lt 50 ]; do
+        sleep 0.1
+        i=$((i + 1))
+    done
+}
+
+stop_server() {
+    kill "$server"
+    wait "$server" 2> /dev/null
+}
+
+run serve_timeout --serve "$tmp/unused.sock" --timeout 0
+fails serve_timeout "expected milliseconds after \`--timeout\`"
+run serve_pool --serve "$tmp/unused.sock" --pool 0
+fails serve_pool "expected worker count after \`--pool\`"
+
+# the daemon runs programs the same way as the command line
+socket="$tmp/bass.sock"
+# server options can come before or after `--serve`
+start_server --timeout 300 --root "$root" --serve "$socket" --pool 2
+for example in fact fib arith data mem rule110; do
+    run "daemon_$example" --client "$socket" "$root/examples/$example.bass"
+    same "example_$example" "daemon_$example"
+done
+run daemon_stdin --client "$socket" - < "$root/examples/fact.bass"
+same example_fact daemon_stdin
+printf 'println r0\nprintln r7\n' > "$tmp/regs.bass"
+run daemon_regs --client "$socket" --reg 0=5 --reg 7=-1 - < "$tmp/regs.bass"
+expect daemon_regs "5
+-1"
+# registers set by the client hold 32-bit values like any other
+printf 'println r0\nadd r1 r0 #1\nprintln r1\n' > "$tmp/regs_wrap.bass"
+run daemon_regs_wrap --client "$socket" --reg 0=5000000000 - \
+    < "$tmp/regs_wrap.bass"
+expect daemon_regs_wrap "705032704
+705032705"
+printf 'println #1\nloop:\njump loop\n' > "$tmp/forever.bass"
+run daemon_timeout --client "$socket" - < "$tmp/forever.bass"
+fails daemon_timeout "stopped the program after 300ms"
+printf 'println #1\n' > "$tmp/outside.bass"
+run daemon_outside --client "$socket" "$tmp/outside.bass"
+fails daemon_outside "is outside of \`$root\`"
+printf '.incbin @0 "%s"\n' "$tmp/map.bin" > "$tmp/incbin.bass"
+run daemon_incbin --client "$socket" - < "$tmp/incbin.bass"
+fails daemon_incbin "for \`.incbin\` at: 1 is outside of \`$root\`"
+"$root/bench/generate.sh" 120000 > "$tmp/huge.bass"
+run daemon_huge --client "$socket" - < "$tmp/huge.bass"
+fails daemon_huge "is larger than the limit"
+# the workers are still there after all of that
+run daemon_after --client "$socket" "$root/examples/fact.bass"
+same example_fact daemon_after
+stop_server
+
+# tracing memory only adds a report on stderr
+for example in fact data mem mem_manipulation rule110; do
+    run "memtrace_$example" --memtrace "$root/examples/$example.bass"
+    same "example_$example" "memtrace_$example"
+done
+printf 'move r0 #0\nmove @r0 #1\nmove @r0 #2\nadd r1 r1 @r0\nadd r1 r1 @r0\nprintln r1\n' \
+    > "$tmp/memtrace.bass"
+run memtrace --memtrace "$tmp/memtrace.bass"
+expect memtrace "4"
+logged memtrace "reads 2, writes 2, misaligned 0"
+
+# files mapped over data are placed after it was loaded, by the daemon as well
+# as the command line, and the data never ends up in the file
+head -c 4096 /dev/zero | tr '\0' '\1' > "$tmp/page.bin"
+cp "$tmp/page.bin" "$tmp/page.orig"
+for mode in ro rw; do
+    run "data_map_$mode" --map "$tmp/page.bin@0:$mode" \
+        "$root/examples/data.bass"
+    socket="$tmp/map_$mode.sock"
+    start_server --map "$tmp/page.bin@0:$mode" \
+        --serve "$socket" --pool 1 --root "$root"
+    # twice, the second request runs on a reset worker
+    for request in 1 2; do
+        run "daemon_map_${mode}_$request" --client "$socket" \
+            "$root/examples/data.bass"
+        same "data_map_$mode" "daemon_map_${mode}_$request"
+    done
+    stop_server
+    if cmp -s "$tmp/page.bin" "$tmp/page.orig"; then
+        passed=$((passed + 1))
+    else
+        fail "data was written into the $mode mapping"
+    fi
+done
+
+# modules linked together run like the same code in a single file
+mkdir -p "$tmp/link/lib"
+printf '.export square\nsquare:\n    mul r0 r0 r0\n    jump square_done\n' \
+    > "$tmp/link/lib/math.bass"
+printf '.import "lib/math.bass"\n.export square_done\nmove r0 #7\njump square\nsquare_done:\nprintln r0\n' \
+    > "$tmp/link/main.bass"
+printf 'move r0 #7\njump square\nsquare_done:\nprintln r0\njump end\nsquare:\n    mul r0 r0 r0\n    jump square_done\nend:\n' \
+    > "$tmp/link/single.bass"
+run link_import "$tmp/link/main.bass"
+run link_single "$tmp/link/single.bass"
+same link_single link_import
+# every copy of an included module has its own labels
+printf 'move r1 #3\ninc:\n    add r0 r0 #1\n    sub r1 r1 #1\n    cmp r1 #0\n    jumpg inc\n' \
+    > "$tmp/link/lib/inc.bass"
+printf '.include "lib/inc.bass"\nprintln r0\n.include "lib/inc.bass"\nprintln r0\n' \
+    > "$tmp/link/include.bass"
+printf 'move r1 #3\na:\n    add r0 r0 #1\n    sub r1 r1 #1\n    cmp r1 #0\n    jumpg a\nprintln r0\nmove r1 #3\nb:\n    add r0 r0 #1\n    sub r1 r1 #1\n    cmp r1 #0\n    jumpg b\nprintln r0\n' \
+    > "$tmp/link/inline.bass"
+run link_include "$tmp/link/include.bass"
+run link_inline "$tmp/link/inline.bass"
+same link_inline link_include
+printf '.export square\nsquare:\n    nop\n' > "$tmp/link/lib/dup.bass"
+printf '.import "lib/math.bass"\n.import "lib/dup.bass"\nprintln #1\n' \
+    > "$tmp/link/dup.bass"
+run link_dup "$tmp/link/dup.bass"
+fails link_dup "label \`square\` is exported by both"
+printf '.import "lib/math.bass"\nprintln #1\n' > "$tmp/link/unresolved.bass"
+run link_unresolved "$tmp/link/unresolved.bass"
+fails link_unresolved "couldnt find label: \`square_done\` at:"
+printf '.include "self.bass"\n' > "$tmp/link/self.bass"
+run link_self "$tmp/link/self.bass"
+fails link_self "ends up including itself"
+# the daemon compiles a cached module again once its file changes
+socket="$tmp/link.sock"
+start_server --serve "$socket" --pool 1 --root "$tmp/link"
+run daemon_link --client "$socket" "$tmp/link/main.bass"
+same link_single daemon_link
+sleep 0.01
+printf '.export square\nsquare:\n    add r0 r0 r0\n    jump square_done\n' \
+    > "$tmp/link/lib/math.bass"
+run daemon_relink --client "$socket" "$tmp/link/main.bass"
+expect daemon_relink "14"
+stop_server
+
+# green threads give the same output as running every copy on its own with
+# its index in r0, whatever the number of workers and the quantum
+for i in 0 1 2 3 4; do
+    { printf 'move r0 #%d\n' "$i"; cat "$root/examples/agents.bass"; } \
+        > "$tmp/agent_$i.bass"
+    "$bass" "$tmp/agent_$i.bass"
+done | sort > "$tmp/agents_plain.out"
+echo 0 > "$tmp/agents_plain.status"
+for setting in "-j 1" "-j 3 --quantum 7" "-j 2 --quantum 1"; do
+    run agents_green --green 5 $setting "$root/examples/agents.bass"
+    sort "$tmp/agents_green.out" > "$tmp/agents_sorted.out"
+    cp "$tmp/agents_green.status" "$tmp/agents_sorted.status"
+    same agents_plain agents_sorted
+done
+run fib_green --green 3 "$root/examples/fib.bass"
+sort "$tmp/fib_green.out" > "$tmp/fib_sorted.out"
+cp "$tmp/fib_green.status" "$tmp/fib_sorted.status"
+for i in 1 2 3; do
+    cat "$tmp/example_fib.out"
+done | sort > "$tmp/fib_plain.out"
+echo 0 > "$tmp/fib_plain.status"
+same fib_plain fib_sorted
+
+# loops run natively give the same results as interpreting them, which
+# `--memtrace` does as it records every access
+cat > "$tmp/kernels.bass" <<'EOF'
+; fill
+move r0 #0
+fill:
+    move @r0 #7
+    add r0 r0 #4
+    cmp r0 #4000
+    jumpl fill
+; fill with a word that isnt a repeated byte
+move r0 #4000
+move r2 #258
+wide:
+    store r0 r2
+    add r0 r0 #4
+    cmp r0 #8000
+    jumpl wide
+; copy to an overlapping higher address
+move r0 #0
+move r2 #40
+copy:
+    move @r2 @r0
+    add r0 r0 #4
+    add r2 r2 #4
+    cmp r0 #4000
+    jumpl copy
+; sum with a counter going down
+move r0 #2000
+move r1 #0
+move r3 #1500
+sum:
+    add r1 r1 @r0
+    add r0 r0 #4
+    sub r3 r3 #1
+    cmp r3 #0
+    jumpg sum
+println r0
+println r1
+println r2
+println r3
+println @4000
+println @7996
+println @3996
+EOF
+run kernels_debug -d "$tmp/kernels.bass"
+if [ "$(grep -c '^Loop:' "$tmp/kernels_debug.out")" = 4 ]; then
+    passed=$((passed + 1))
+else
+    fail "the loops of \`kernels.bass\` werent all found"
+fi
+run kernels "$tmp/kernels.bass"
+run kernels_traced --memtrace "$tmp/kernels.bass"
+same kernels kernels_traced
+# the loops are found again for every request on the cached module
+socket="$tmp/kernels.sock"
+start_server --serve "$socket" --pool 1 --root "$tmp"
+for request in 1 2; do
+    run "daemon_kernels_$request" --client "$socket" "$tmp/kernels.bass"
+    same kernels "daemon_kernels_$request"
+done
+stop_server
+
+# a loop run natively still ends its slice once the quantum is used up
+printf 'move r0 #0\nfill:\n    move @r0 #7\n    add r0 r0 #4\n    cmp r0 #400000\n    jumpl fill\nprintln r0\n' \
+    > "$tmp/green_fill.bass"
+run green_fill_plain "$tmp/green_fill.bass"
+run green_fill --green 1 --quantum 1000 --stats "$tmp/green_fill.bass"
+same green_fill_plain green_fill
+preemptions=$(awk '$1 == "preemptions" { print $2 }' "$tmp/green_fill.err")
+if [ "$preemptions" = 400 ]; then
+    passed=$((passed + 1))
+else
+    fail "\`green_fill\` was preempted ${preemptions:-0} times instead of 400"
+fi
+
+# edits that only parse the changed lines again give the same program as
+# parsing the whole file, watch mode restarts a finished program with them
+awk 'BEGIN {
+    for (i = 0; i < 100; i++) {
+        printf "step_%d:\n    add r0 r0 #%d\n    mul r1 r0 #3\n    println r1\n", i, i
+    }
+    printf "cmp r0 #20000\njumpl step_95\n"
+}' > "$tmp/splice.bass"
+cp "$tmp/splice.bass" "$tmp/splice_0.bass"
+start_watch watch_splice "$tmp/splice.bass"
+edit=0
+for change in 's/r0 #50$/r0 #500/' 's/^step_20:$/step_20:\n    add r0 r0 #1000/' \
+    '/r0 #80$/d'; do
+    edit=$((edit + 1))
+    sed -i "$change" "$tmp/splice.bass"
+    cp "$tmp/splice.bass" "$tmp/splice_$edit.bass"
+    sleep 0.3
+done
+stop_watch
+for i in 0 1 2 3; do
+    "$bass" "$tmp/splice_$i.bass"
+done > "$tmp/splice_plain.out"
+echo 0 > "$tmp/splice_plain.status"
+echo 0 > "$tmp/watch_splice.status"
+same splice_plain watch_splice
+if [ "$(grep -c 'edited lines parsed' "$tmp/watch_splice.err")" = 3 ]; then
+    passed=$((passed + 1))
+else
+    fail "\`watch_splice\` parsed the whole file after an edit"
+    head -n 5 "$tmp/watch_splice.err"
+fi
+
+# watch mode swaps an edit in after an import changed on disk, which compiles
+# the import again while the old program still points into it
+mkdir "$tmp/watch"
+printf '.import "lib.bass"\n.export back\ntop:\n    jump run\nback:\n    add r0 r0 #1\n    jump top\n' \
+    > "$tmp/watch/main.bass"
+printf '.export run\nrun:\n    add r1 r1 #1\n    jump back\n' \
+    > "$tmp/watch/lib.bass"
+start_watch watch_import "$tmp/watch/main.bass"
+printf '; changed\n' >> "$tmp/watch/lib.bass"
+sleep 0.2
+printf '; edited\n' >> "$tmp/watch/main.bass"
+sleep 0.5
+stop_watch
+logged watch_import "swapped in \`$tmp/watch/main.bass\` at opcode"
+# imports are watched as well
+start_watch watch_lib "$tmp/watch/main.bass"
+printf '; changed again\n' >> "$tmp/watch/lib.bass"
+sleep 0.5
+stop_watch
+logged watch_lib "swapped in \`$tmp/watch/main.bass\` at opcode"
+
+# the last line of a file doesnt need a newline
+printf 'println #55' > "$tmp/no_newline.bass"
+run no_newline "$tmp/no_newline.bass"
+expect no_newline "55"
+
+echo "$passed passed, $failed failed"
+[ "$failed" = 0 ]